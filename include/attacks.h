@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "move.h"
+#include "piece.h"
+
+// Squares attacked in one position, filled by the evaluation so that move ordering at
+// the same node can reuse them.
+typedef struct AttackMaps {
+    uint64_t key;  // board_key of the position, 0 while not filled
+    uint64_t by_type[7][2];  // [type][color]
+    uint64_t by_color[2];
+} AttackMaps;
+
+extern uint64_t knight_attacks[64];
+extern uint64_t king_attacks[64];
+extern uint64_t pawn_attacks[2][64];  // [color][square] squares attacked by a pawn on square
+
+void attacks_init(void);
+
+uint64_t bishop_attacks(size_t idx, uint64_t occupied);
+
+uint64_t rook_attacks(size_t idx, uint64_t occupied);
+
+uint64_t piece_attacks(PieceType type, size_t idx, uint64_t occupied);
+
+uint64_t color_bb(const Board *board, Color color);
+
+uint64_t occupied_bb(const Board *board);
+
+uint64_t attackers_to(const Board *board, size_t idx, uint64_t occupied);
+
+bool see_ge(const Board *board, Move move, int64_t threshold);
+
+// ====================================
+
+void test_attacks_leapers(void);
+void test_attacks_sliders(void);
+void test_see(void);
+void test_attacks(void);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "constants.h"
 #include "piece.h"
 #include "move.h"
 
@@ -17,7 +18,11 @@ typedef struct Board {
     Color to_move;
     uint64_t king_bb[2];
 
-    uint64_t bb[6][2];
+    uint64_t bb[7][2];
+    uint64_t hash;  // Zobrist hash of the pieces only, see board_key
+    uint64_t pawn_hash;  // Zobrist hash of the pawns only, keys pawn structure tables
+    Score psqt_score;  // Sum of psqt over all pieces, White's point of view
+    int32_t phase;  // Sum of phase_weights over all pieces, PHASE_MAX with the starting material
 
     uint64_t attacked;
     bool attacked_evaluated;
@@ -41,6 +46,10 @@ void board_reset(Board *board);
 
 Board *board_create(void);
 
+void board_copy(Board *dst, const Board *src);
+
+uint64_t board_key(Board *board);
+
 bool is_attacked(Board *board, size_t idx);
 
 void set_attacked(Board *board, size_t idx);
@@ -61,6 +70,10 @@ void undo_last_move_base(Board *board, bool invalidate_attacked);
 
 void undo_last_move(Board *board);
 
+void apply_null_move(Board *board);
+
+void undo_null_move(Board *board);
+
 size_t n_moves_since_last_pawn_or_capture_move(Board* board);
 
 char *board_to_fen(Board *board, DA *da);
@@ -85,8 +98,10 @@ void test_board_initial(void);
 void test_board_display(void);
 void test_apply_move(void);
 void test_undo_last_move(void);
+void test_null_move(void);
 void test_board_to_fen(void);
 void test_fen_to_board(void);
 void test_san_notation_to_move(void);
 void test_uci_notation_to_move(void);
+void test_incremental_eval_terms(void);
 void test_board(void);
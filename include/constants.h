@@ -1,2 +1,20 @@
-extern int piece_val_offsets[6][2][64];
-extern int end_game_king_val_offsets[2][64];
+#pragma once
+
+#include <stdint.h>
+
+#include "piece.h"
+
+// A midgame and an endgame value packed into one integer, the midgame half in the low
+// 16 bits, so that both phases are summed with a single addition.
+typedef int32_t Score;
+
+#define S(mg, eg) ((Score) ((uint32_t) (int32_t) (eg) << 16) + (Score) (mg))
+#define MG_VALUE(s) ((int16_t) (uint16_t) (uint32_t) (s))
+#define EG_VALUE(s) ((int16_t) (uint16_t) ((uint32_t) ((s) + 0x8000) >> 16))
+
+#define PHASE_MAX 64  // Phase of the starting material, a power of two so tapering ends in a shift
+
+extern const int32_t phase_weights[7];
+extern Score psqt[7][2][64];  // [type][color][idx] piece value plus square bonus, Black's negated
+
+void psqt_init(void);
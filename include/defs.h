@@ -1,6 +1,8 @@
 #define ENGINE_NAME "Munchess 0.3-alpha"
 #define ENGINE_AUTHOR "Isura"
 
+#define CACHE_LINE_SIZE 64
+
 #define simple(c) ((char)((c) | 32))
 #define capital(c) ((char)(c) & ~32)
 #define dtoc(d) ((char)((d) + '0'))
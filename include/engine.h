@@ -1,9 +1,49 @@
 #pragma once
 
+#include <stdatomic.h>
+
 #include "board.h"
+#include "eval.h"
 #include "move.h"
+#include "timeman.h"
+#include "tt.h"
+#include "utils.h"
+
+#define MAX_PLY 128
+#define MAX_MOVES 256  // More than any legal position has
+#define MAX_THREADS 64  // Each SearchThread takes about 7 MB, mostly continuation history
+#define HISTORY_MAX 16384
+#define CORRECTION_HISTORY_SIZE 16384  // Entries per side to move, power of two
+#define CONTINUATION_PLIES 2  // Continuation history follows the moves one and two plies back
+#define MAX_MULTI_PV 64
+
+typedef struct SearchInfo {
+    size_t depth;
+    size_t seldepth;
+    size_t multi_pv;  // 1 for the best line
+    int64_t score;
+    int64_t mate;  // Moves to mate, negative when getting mated, 0 if no mate was found
+    size_t nodes;  // Summed over all search threads
+    size_t nps;
+    size_t time_ms;
+    size_t hashfull;  // Permill
+    Move move;  // First move of pv
+    const uint32_t *pv;  // Move data, only valid during the callback
+    size_t pv_length;
+} SearchInfo;
 
-typedef void (*on_score_event_f)(Move move, size_t depth, int64_t cp);
+typedef struct SearchStats {
+    size_t nodes;
+    size_t qnodes;
+    size_t tt_hits;
+    size_t beta_cutoffs;
+    size_t first_move_cutoffs;  // Beta cutoffs caused by the first move searched
+    size_t seldepth;  // Deepest ply reached
+} SearchStats;
+
+typedef void (*on_score_event_f)(const SearchInfo *info);
+
+typedef void (*on_currmove_event_f)(Move move, size_t number, size_t depth);
 
 typedef enum EngineState UNDERLYING(uint8_t) {
     ENGINE_NOT_STARTED=0,
@@ -11,21 +51,115 @@ typedef enum EngineState UNDERLYING(uint8_t) {
     ENGINE_BUSY,
 } EngineState;
 
+typedef struct SearchLimits {
+    size_t depth;  // 0 for the default depth, or no depth limit if another limit is set
+    size_t nodes;  // 0 for no node limit
+    bool clock;  // time and inc are set
+    int64_t time[2];  // Remaining milliseconds by color
+    int64_t inc[2];
+    size_t moves_to_go;  // 0 if not given
+    int64_t move_time;  // Exact milliseconds to spend, 0 if not given
+    bool infinite;  // Keep searching until stopped
+    bool ponder;  // Search the expected reply until ponderhit or stop
+} SearchLimits;
+
+typedef struct Engine Engine;
+
+typedef int32_t PieceToHistory[2][7][64];  // [color][piece][to], bounded by HISTORY_MAX
+
+// Everything a search thread writes to. Aligned to a cache line so that threads never share one.
+typedef struct SearchThread {
+    _Alignas(CACHE_LINE_SIZE) Engine *engine;
+    size_t id;
+    Thread handle;
+    Board *board;  // Private copy of the position being searched
+    DAi32 root_moves;
+    DAi32 best_moves;  // Best moves of the last completed iteration
+    uint32_t best_pv[MAX_PLY];  // Principal variation of the last completed iteration
+    size_t best_pv_length;
+    int64_t best_eval;
+    int64_t pv_evals[MAX_MULTI_PV];  // Score of each line in the last iteration
+    size_t completed_depth;
+    atomic_size_t nodes;  // Read by the main thread while searching
+    SearchStats stats;  // Everything but nodes, only read once the search is over
+    bool stopped;  // Local copy of Engine.stop, refreshed every few nodes
+
+    // Triangular PV table: pv[ply] holds the best line from ply on, pv_length[ply] is one past its end.
+    uint32_t pv[MAX_PLY][MAX_PLY];
+    size_t pv_length[MAX_PLY];
+    bool follow_pv;  // Still on the previous iteration's PV, whose moves are searched first
+
+    size_t root_depth;  // Depth of the current iteration
+    size_t path_extensions;  // Plies of extension on the path to the current node
+    uint32_t excluded_moves[MAX_PLY];  // Move left out by a singular search at that ply, 0 if none
+
+    uint32_t killers[MAX_PLY][2];  // Quiet moves that caused a beta cutoff at the same ply
+    int32_t history[2][64][64];  // [color][from][to] quiet move history, bounded by HISTORY_MAX
+    uint32_t countermoves[2][7][64];  // Quiet reply that refuted the previous move, by its [color][piece][to]
+    int32_t capture_history[2][7][64][7];  // [color][piece][to][captured]
+    // [plies back - 1][color][piece][to] of an earlier move, then the same for the move played now.
+    PieceToHistory continuation_history[CONTINUATION_PLIES][2][7][64];
+    // [side to move][pawn hash] average of search score minus static eval, in CORRECTION_GRAIN units
+    int32_t correction_history[2][CORRECTION_HISTORY_SIZE];
+
+    PawnTable pawn_table;
+    AttackMaps attack_maps[MAX_PLY];  // Left by the evaluation at each ply for move ordering
+} SearchThread;
+
 typedef struct Engine {
     EngineState state;
     Board *board;
     DAi32 *moves;
 
+    TT *tt;  // Shared by all search threads
+    EvalCache *eval_cache;  // Shared by all search threads, sized independently of the TT
+    SearchThread *threads;  // threads[0] is the main thread, the rest are helpers
+    size_t n_threads;
+    Board *thread_boards[MAX_THREADS];  // Created on first use and kept across engine_set_threads
+    size_t multi_pv;  // Number of best lines to search and report
+    bool random_tie_break;  // Pick randomly among equally scored best moves, else the first
+    atomic_bool stop;
+    atomic_bool pondering;  // Cleared by ponderhit, the limits apply from then on
+    SearchLimits limits;
+    Move ponder_move;  // Expected reply to the last best move, null if unknown
+    time_t start_time;  // Microseconds, see time_now
+    TimeManager time_manager;
+    SearchStats stats;  // Of the last search, over all threads
+
     on_score_event_f on_score;
+    on_currmove_event_f on_currmove;
 } Engine;
 
 Engine *engine_create(on_score_event_f on_score);
 
 void engine_start(Engine *engine);
 
-Move engine_best_move(Engine *engine, Board *board);
+void engine_set_threads(Engine *engine, size_t n_threads);
+
+bool engine_set_hash_size(Engine *engine, size_t size_mb);
+
+bool engine_set_eval_cache_size(Engine *engine, size_t size_mb);
+
+void engine_set_multi_pv(Engine *engine, size_t multi_pv);
+
+void engine_new_game(Engine *engine);
+
+size_t engine_nodes(Engine *engine);
+
+void engine_stop(Engine *engine);
+
+void engine_ponderhit(Engine *engine);
+
+Move engine_best_move(Engine *engine, Board *board, SearchLimits limits);
 
 // ================================
 
 void test_move_sequence(void);
+void test_multi_threaded_search(void);
+void test_multi_pv(void);
+void test_principal_variation(void);
+void test_mate_scores(void);
+void test_deterministic_search(void);
+void test_move_ordering_histories(void);
+void test_correction_history(void);
 void test_engine(void);
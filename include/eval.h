@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "attacks.h"
+#include "board.h"
+#include "constants.h"
+
+#define PAWN_TABLE_SIZE 16384  // Entries, power of two
+#define EVAL_CACHE_DEFAULT_SIZE_MB 4
+#define EVAL_CACHE_MAX_SIZE_MB 1024
+
+// Everything the evaluation derives from the pawns alone, so it can be cached by pawn hash.
+typedef struct PawnEntry {
+    uint64_t key;  // Board.pawn_hash
+    Score score;  // Pawn structure score, White's point of view
+    uint64_t passed[2];  // Passed pawns of each color
+} PawnEntry;
+
+// Direct-mapped cache of pawn entries. Each search thread owns one, so it needs no locking.
+typedef struct PawnTable {
+    PawnEntry entries[PAWN_TABLE_SIZE];
+} PawnTable;
+
+// Direct-mapped cache of full static evals, shared by all search threads. As in the TT the
+// key is stored xor-ed with the eval, so a torn entry fails verification and no locks are needed.
+typedef struct EvalCacheEntry {
+    uint64_t key;
+    uint64_t eval;
+} EvalCacheEntry;
+
+typedef struct EvalCache {
+    EvalCacheEntry *entries;
+    size_t size;  // Power of two
+} EvalCache;
+
+EvalCache *eval_cache_create(size_t size_mb);
+
+bool eval_cache_resize(EvalCache *cache, size_t size_mb);
+
+size_t eval_cache_size_mb(EvalCache *cache);
+
+void eval_cache_clear(EvalCache *cache);
+
+bool eval_cache_probe(EvalCache *cache, uint64_t key, int64_t *eval);
+
+void eval_cache_store(EvalCache *cache, uint64_t key, int64_t eval);
+
+PawnEntry evaluate_pawns(const Board *board);
+
+PawnEntry probe_pawns(const Board *board, PawnTable *table);
+
+Score evaluate_pieces(Board *board, Color color, uint64_t occupied, AttackMaps *maps);
+
+int64_t taper(const Board *board, Score score);
+
+int64_t evaluate_board(Board *board, EvalCache *cache, PawnTable *pawn_table, AttackMaps *maps, int64_t alpha, int64_t beta);
+
+// ====================================
+
+void test_eval_cache(void);
+void test_pawn_structure(void);
+void test_pawn_table(void);
+void test_mobility(void);
+void test_king_danger(void);
+void test_lazy_eval(void);
+void test_eval_symmetry(void);
+void test_eval(void);
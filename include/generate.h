@@ -12,22 +12,30 @@ bool is_king_in_check(Board *board);
 
 bool validate_and_push_move(Board *board, DAi32 *moves, Move move);
 
-bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found);
+bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only);
 
-bool generate_bishop_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found);
+bool generate_bishop_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only);
 
-bool generate_rook_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found);
+bool generate_rook_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only);
 
-bool generate_queen_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found);
+bool generate_queen_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only);
 
-bool generate_knight_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found);
+bool generate_knight_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only);
 
-bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found);
+bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only);
+
+bool generate_moves_base(Board *board, DAi32 *moves, bool return_on_found, bool captures_only);
 
 void generate_moves(Board *board, DAi32 *moves);
 
+void generate_captures(Board *board, DAi32 *moves);
+
+bool has_legal_move(Board *board);
+
 // ==================================
 
 void test_generate_initial_moves(void);
+void test_generate_captures(void);
+void test_has_legal_move(void);
 
 void test_generate(void);
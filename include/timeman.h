@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define TM_MOVE_OVERHEAD_MS 30  // Kept in reserve for GUI and OS latency
+#define TM_DEFAULT_MOVES_TO_GO 30
+#define TM_MAX_MOVES_TO_GO 50
+#define TM_HARD_FACTOR 4  // Hard limit in multiples of the soft limit
+#define TM_MAX_TIME_PCT 80  // Share of the remaining time a single move may use
+#define TM_UNSTABLE_PCT 150  // Soft limit scale right after the best move changed
+#define TM_STABLE_STEP_PCT 10  // Soft limit shrink per iteration with the same best move
+#define TM_MIN_PCT 50
+
+// Soft limit: checked between iterations, no new iteration is started past it.
+// Hard limit: checked inside the search, which is stopped once it is reached.
+typedef struct TimeManager {
+    bool enabled;
+    bool fixed;  // go movetime: no stability scaling, only the hard limit stops the search
+    time_t start;  // Microseconds, see time_now
+    int64_t soft_ms;  // Before scaling by stability
+    int64_t hard_ms;
+    size_t scale_pct;
+    size_t stable_iterations;
+} TimeManager;
+
+void time_manager_init(TimeManager *tm, time_t start, int64_t time_ms, int64_t inc_ms, size_t moves_to_go);
+
+void time_manager_init_move_time(TimeManager *tm, time_t start, int64_t move_time_ms);
+
+void time_manager_disable(TimeManager *tm);
+
+void time_manager_update(TimeManager *tm, bool best_move_changed);
+
+int64_t time_manager_elapsed_ms(TimeManager *tm);
+
+int64_t time_manager_soft_limit_ms(TimeManager *tm);
+
+bool time_manager_soft_exceeded(TimeManager *tm);
+
+bool time_manager_hard_exceeded(TimeManager *tm);
+
+// ====================================
+
+void test_time_manager_clock(void);
+void test_time_manager_stability(void);
+void test_time_manager_move_time(void);
+void test_time_manager(void);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "defs.h"
+#include "move.h"
+
+#define TT_DEFAULT_SIZE_MB 16
+#define TT_MAX_SIZE_MB 4096
+#define TT_CLUSTER_SIZE 4
+#define TT_HASHFULL_SAMPLE 1000
+
+typedef enum TTBound UNDERLYING(uint8_t) {
+    TT_NONE=0,
+    TT_UPPER,
+    TT_LOWER,
+    TT_EXACT,
+} TTBound;
+
+typedef union TTData {
+    struct {
+        uint64_t move : 16;  // from, to and promoted type, see tt_pack_move
+        int64_t score : 24;
+        uint64_t depth : 8;
+        uint64_t bound : 2;
+        uint64_t age : 6;
+    };
+    uint64_t data;
+} TTData;
+
+// The key is stored xor-ed with the data, so an entry torn by two threads writing at once
+// fails verification instead of returning another position's data. No locks are needed.
+typedef struct TTEntry {
+    uint64_t key;
+    uint64_t data;
+} TTEntry;
+
+typedef struct TT {
+    TTEntry *entries;  // Clusters of TT_CLUSTER_SIZE entries, each a cache line
+    size_t n_clusters;
+    uint8_t age;
+} TT;
+
+TT *tt_create(size_t size_mb);
+
+bool tt_resize(TT *tt, size_t size_mb);
+
+size_t tt_size_mb(TT *tt);
+
+void tt_clear(TT *tt);
+
+void tt_new_search(TT *tt);
+
+uint16_t tt_pack_move(Move move);
+
+bool tt_move_matches(uint16_t packed, Move move);
+
+bool tt_probe(TT *tt, uint64_t key, TTData *data);
+
+void tt_store(TT *tt, uint64_t key, Move move, int64_t score, size_t depth, TTBound bound);
+
+size_t tt_hashfull(TT *tt);
+
+// ====================================
+
+void test_tt_data_size(void);
+void test_tt_store_probe(void);
+void test_tt_hashfull(void);
+
+void test_tt_resize(void);
+void test_tt(void);
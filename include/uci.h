@@ -6,6 +6,7 @@
 #include "board.h"
 #include "defs.h"
 #include "engine.h"
+#include "utils.h"
 
 typedef enum UCIState UNDERLYING(uint8_t) {
     UCI_NOT_READY=0,
@@ -21,6 +22,9 @@ typedef struct UCI {
     Move last_move;
     FILE *log_fp;
     int pid;  // Process id
+    Thread search_thread;
+    bool searching;
+    Mutex io_mutex;  // Output and log lines come from both the input loop and the search thread
 } UCI;
 
 extern char *position_parser;
@@ -44,12 +48,32 @@ void send_uci_ok();
 
 void send_is_ready();
 
-void send_info_score_cp(Move move, size_t depth, int64_t cp);
+void send_info_score_cp(const SearchInfo *info);
+
+void send_info_currmove(Move move, size_t number, size_t depth);
+
+void send_info_stats(void);
 
 const char *uci_store_board(const char *fen);
 
 void parse_position_command(const char *input);
 
-void send_best_move();
+size_t parse_option_value(void);
+
+bool parse_option_bool(void);
+
+void parse_setoption_command(const char *input);
+
+size_t parse_go_value(void);
+
+int64_t parse_go_time(void);
+
+SearchLimits parse_go_command(const char *input);
+
+void send_best_move(SearchLimits limits);
+
+void start_search(SearchLimits limits);
+
+void wait_search(void);
 
 void start_uci(void);
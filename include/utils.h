@@ -3,27 +3,53 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #define getpid GetCurrentProcessId
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
 #else
 #include <unistd.h>
 #include <sys/types.h>
+#include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
 #endif
 
+typedef void (*thread_main_f)(void *arg);
+
 unsigned rand_lim(unsigned limit);
 
 int rand_range(int a, int b);
 
 time_t time_now(void);
 
+void sleep_ms(unsigned ms);
+
 char *read_file(const char *path);
 
 void error_exit(int status);
 
 uint8_t next_piece_idx(uint64_t bb);
 
+size_t count_bits(uint64_t bb);
+
+bool thread_create(Thread *thread, thread_main_f main, void *arg);
+
+void thread_join(Thread thread);
+
+void mutex_init(Mutex *mutex);
+
+void mutex_lock(Mutex *mutex);
+
+void mutex_unlock(Mutex *mutex);
+
+void *aligned_malloc(size_t alignment, size_t size);
+
+void aligned_free(void *ptr);
+
 #define READ_LINE_CHUNK_SIZE 2048
 char *read_line(FILE *fp);
 
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "piece.h"
+
+extern uint64_t zobrist_pieces[2][7][64];
+extern uint64_t zobrist_black_to_move;
+extern uint64_t zobrist_castling[16];
+extern uint64_t zobrist_en_passant[8];
+
+void zobrist_init(void);
+
+// ====================================
+
+void test_zobrist_transposition(void);
+void test_zobrist_undo(void);
+void test_zobrist_pawn_hash(void);
+void test_zobrist(void);
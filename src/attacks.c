@@ -0,0 +1,238 @@
+#include <assert.h>
+#include <stdbool.h>
+
+#include "attacks.h"
+#include "defs.h"
+#include "utils.h"
+#include "tests.h"
+
+uint64_t knight_attacks[64];
+uint64_t king_attacks[64];
+uint64_t pawn_attacks[2][64];
+
+static const int64_t see_values[] = {
+    [NONE] = 0,
+    [PAWN] = 100,
+    [KNIGHT] = 320,
+    [BISHOP] = 330,
+    [ROOK] = 500,
+    [QUEEN] = 900,
+    [KING] = 20000,
+};
+
+uint64_t step_bb(size_t idx, int dy, int dx) {
+    int y = (int) IDX_Y(idx) + dy;
+    int x = (int) IDX_X(idx) + dx;
+    if (y < 0 || y > 7 || x < 0 || x > 7) {
+        return 0;
+    }
+    return 1ULL << IDX(y, x);
+}
+
+void attacks_init(void) {
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    static const int knight_steps[8][2] = {{1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1}};
+    static const int king_steps[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    for (size_t idx = 0; idx < 64; ++idx) {
+        knight_attacks[idx] = 0;
+        king_attacks[idx] = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            knight_attacks[idx] |= step_bb(idx, knight_steps[i][0], knight_steps[i][1]);
+            king_attacks[idx] |= step_bb(idx, king_steps[i][0], king_steps[i][1]);
+        }
+        pawn_attacks[WHITE][idx] = step_bb(idx, 1, -1) | step_bb(idx, 1, 1);
+        pawn_attacks[BLACK][idx] = step_bb(idx, -1, -1) | step_bb(idx, -1, 1);
+    }
+    initialized = true;
+}
+
+// Squares reached from idx along the given directions, up to and including the first blocker.
+uint64_t ray_attacks(size_t idx, uint64_t occupied, const int dirs[4][2]) {
+    uint64_t attacks = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        int y = (int) IDX_Y(idx) + dirs[i][0];
+        int x = (int) IDX_X(idx) + dirs[i][1];
+        while (y >= 0 && y <= 7 && x >= 0 && x <= 7) {
+            uint64_t square = 1ULL << IDX(y, x);
+            attacks |= square;
+            if (occupied & square) {
+                break;
+            }
+            y += dirs[i][0];
+            x += dirs[i][1];
+        }
+    }
+    return attacks;
+}
+
+uint64_t bishop_attacks(size_t idx, uint64_t occupied) {
+    static const int dirs[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    return ray_attacks(idx, occupied, dirs);
+}
+
+uint64_t rook_attacks(size_t idx, uint64_t occupied) {
+    static const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    return ray_attacks(idx, occupied, dirs);
+}
+
+// Attacks of a knight, bishop, rook, queen or king on idx.
+uint64_t piece_attacks(PieceType type, size_t idx, uint64_t occupied) {
+    switch (type) {
+    case KNIGHT:
+        return knight_attacks[idx];
+    case BISHOP:
+        return bishop_attacks(idx, occupied);
+    case ROOK:
+        return rook_attacks(idx, occupied);
+    case QUEEN:
+        return bishop_attacks(idx, occupied) | rook_attacks(idx, occupied);
+    case KING:
+        return king_attacks[idx];
+    default:
+        assert(0);
+        return 0;
+    }
+}
+
+uint64_t color_bb(const Board *board, Color color) {
+    uint64_t bb = 0;
+    for (size_t type = PAWN; type <= KING; ++type) {
+        bb |= board->bb[type][color];
+    }
+    return bb;
+}
+
+uint64_t occupied_bb(const Board *board) {
+    return color_bb(board, WHITE) | color_bb(board, BLACK);
+}
+
+// Pieces of both colors attacking idx, with sliders seeing through the squares missing
+// from occupied.
+uint64_t attackers_to(const Board *board, size_t idx, uint64_t occupied) {
+    uint64_t diagonal = board->bb[BISHOP][WHITE] | board->bb[BISHOP][BLACK]
+        | board->bb[QUEEN][WHITE] | board->bb[QUEEN][BLACK];
+    uint64_t straight = board->bb[ROOK][WHITE] | board->bb[ROOK][BLACK]
+        | board->bb[QUEEN][WHITE] | board->bb[QUEEN][BLACK];
+    return (pawn_attacks[BLACK][idx] & board->bb[PAWN][WHITE])
+        | (pawn_attacks[WHITE][idx] & board->bb[PAWN][BLACK])
+        | (knight_attacks[idx] & (board->bb[KNIGHT][WHITE] | board->bb[KNIGHT][BLACK]))
+        | (king_attacks[idx] & (board->bb[KING][WHITE] | board->bb[KING][BLACK]))
+        | (bishop_attacks(idx, occupied) & diagonal)
+        | (rook_attacks(idx, occupied) & straight);
+}
+
+// Static exchange evaluation: whether the exchange sequence started by move on its target
+// square gains at least threshold, with both sides always recapturing with their least
+// valuable attacker and free to stop. Pins are ignored.
+bool see_ge(const Board *board, Move move, int64_t threshold) {
+    if (move_is_type_of(move, CASTLE | PROMOTION | EN_PASSANT)) {
+        return 0 >= threshold;
+    }
+    size_t from = move.from;
+    size_t to = move.to;
+    int64_t swap = see_values[board->pieces[to].type] - threshold;
+    if (swap < 0) {
+        return false;
+    }
+    swap = see_values[board->pieces[from].type] - swap;
+    if (swap <= 0) {
+        return true;
+    }
+
+    uint64_t diagonal = board->bb[BISHOP][WHITE] | board->bb[BISHOP][BLACK]
+        | board->bb[QUEEN][WHITE] | board->bb[QUEEN][BLACK];
+    uint64_t straight = board->bb[ROOK][WHITE] | board->bb[ROOK][BLACK]
+        | board->bb[QUEEN][WHITE] | board->bb[QUEEN][BLACK];
+    uint64_t occupied = occupied_bb(board) ^ (1ULL << from) ^ (1ULL << to);
+    uint64_t attackers = attackers_to(board, to, occupied);
+    Color side = board->pieces[from].color;
+    int64_t result = 1;
+
+    while (true) {
+        side = !side;
+        attackers &= occupied;
+        uint64_t side_attackers = attackers & color_bb(board, side);
+        if (side_attackers == 0) {
+            break;
+        }
+        result ^= 1;
+
+        PieceType type = PAWN;
+        while (type < KING && (side_attackers & board->bb[type][side]) == 0) {
+            ++type;
+        }
+        if (type == KING) {
+            // Capturing with the king is only legal if the other side has nothing left.
+            return (attackers & ~color_bb(board, side)) ? !result : result;
+        }
+        swap = see_values[type] - swap;
+        if (swap < result) {
+            break;
+        }
+        uint64_t attacker = side_attackers & board->bb[type][side];
+        occupied ^= attacker & -attacker;
+        if (type == PAWN || type == BISHOP || type == QUEEN) {
+            attackers |= bishop_attacks(to, occupied) & diagonal;
+        }
+        if (type == ROOK || type == QUEEN) {
+            attackers |= rook_attacks(to, occupied) & straight;
+        }
+    }
+    return result;
+}
+
+// ====================================
+
+void test_attacks_leapers(void) {
+    attacks_init();
+    assert(count_bits(knight_attacks[COORD_TO_IDX("a1")]) == 2);
+    assert(count_bits(knight_attacks[COORD_TO_IDX("d4")]) == 8);
+    assert(count_bits(king_attacks[COORD_TO_IDX("h8")]) == 3);
+    assert(pawn_attacks[WHITE][COORD_TO_IDX("e4")] == ((1ULL << COORD_TO_IDX("d5")) | (1ULL << COORD_TO_IDX("f5"))));
+    assert(pawn_attacks[BLACK][COORD_TO_IDX("a7")] == (1ULL << COORD_TO_IDX("b6")));
+}
+
+void test_attacks_sliders(void) {
+    attacks_init();
+    assert(count_bits(rook_attacks(COORD_TO_IDX("a1"), 0)) == 14);
+    assert(count_bits(bishop_attacks(COORD_TO_IDX("d4"), 0)) == 13);
+    // Blockers are attacked, squares behind them are not.
+    uint64_t occupied = 1ULL << COORD_TO_IDX("a4");
+    uint64_t attacks = rook_attacks(COORD_TO_IDX("a1"), occupied);
+    assert(attacks & (1ULL << COORD_TO_IDX("a4")));
+    assert(!(attacks & (1ULL << COORD_TO_IDX("a5"))));
+}
+
+void test_see(void) {
+    struct {
+        const char *fen;
+        const char *from;
+        const char *to;
+        int64_t gain;  // Exact exchange result
+    } cases[] = {
+        // Undefended pawn.
+        {"4k3/8/8/3p4/8/8/8/3RK3 w - - 0 1", "d1", "d5", 100},
+        // Pawn defended by a pawn, the rook is lost for it.
+        {"4k3/8/2p5/3p4/8/8/8/3RK3 w - - 0 1", "d1", "d5", 100 - 500},
+        // Knight takes a defended pawn, backed up by a rook behind the first attacker.
+        {"4k3/8/4p3/3p4/8/4N3/8/3RK3 w - - 0 1", "e3", "d5", 100 - 320 + 100},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        Board *board = board_create();
+        (void) fen_to_board(cases[i].fen, board);
+        size_t from = COORD_TO_IDX(cases[i].from);
+        size_t to = COORD_TO_IDX(cases[i].to);
+        Move move = move_create(board->pieces[from], from, to, CAPTURE, NONE, board->pieces[to].type);
+        assert(see_ge(board, move, cases[i].gain));
+        assert(!see_ge(board, move, cases[i].gain + 1));
+    }
+}
+
+void test_attacks(void) {
+    test_wrapper(test_attacks_leapers);
+    test_wrapper(test_attacks_sliders);
+    test_wrapper(test_see);
+}
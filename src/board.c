@@ -6,6 +6,7 @@
 #pragma intrinsic(_mm_popcnt_u64)
 #endif
 
+#include "attacks.h"
 #include "board.h"
 #include "common.h"
 #include "defs.h"
@@ -13,6 +14,7 @@
 #include "piece.h"
 #include "utils.h"
 #include "tests.h"
+#include "zobrist.h"
 
 bool idx_is_safe(size_t idx) {
     return idx < 64;
@@ -35,6 +37,12 @@ void clear_square(Board *board, size_t idx) {
     }
     Piece piece = board->pieces[idx];
     board->bb[piece.type][piece.color] &= ~(1ULL << idx);
+    board->hash ^= zobrist_pieces[piece.color][piece.type][idx];
+    board->psqt_score -= psqt[piece.type][piece.color][idx];
+    board->phase -= phase_weights[piece.type];
+    if (piece.type == PAWN) {
+        board->pawn_hash ^= zobrist_pieces[piece.color][PAWN][idx];
+    }
     board->pieces[idx].data = 0;
 }
 
@@ -44,6 +52,12 @@ void set_piece_with(Board *board, size_t idx, Color color, PieceType type) {
     }
     clear_square(board, idx);
     board->bb[type][color] |= 1ULL << idx;
+    board->hash ^= zobrist_pieces[color][type][idx];
+    board->psqt_score += psqt[type][color][idx];
+    board->phase += phase_weights[type];
+    if (type == PAWN) {
+        board->pawn_hash ^= zobrist_pieces[color][PAWN][idx];
+    }
     board->pieces[idx].data = 0;
     board->pieces[idx].color = color;
     board->pieces[idx].type = type;
@@ -54,6 +68,9 @@ void set_piece(Board *board, size_t idx, Piece piece) {
 }
 
 void board_reset(Board *board) {
+    zobrist_init();
+    attacks_init();
+    psqt_init();
     for (size_t i = 0; i < 64; ++i) {
         clear_square(board, i);
     }
@@ -81,6 +98,10 @@ void board_reset(Board *board) {
         }
     }
 
+    board->hash = 0;
+    board->pawn_hash = 0;
+    board->psqt_score = 0;
+    board->phase = 0;
     board->time_to_generate_last_move_us = 0;
     board->attacked = 0;
     board->attacked_evaluated = false;
@@ -88,11 +109,45 @@ void board_reset(Board *board) {
 
 Board *board_create(void) {
     Board *board = (Board *) arena_allocate(&arena, sizeof(Board));
+    memset(board, 0, sizeof(Board));
     board->moves = dai32_create();
     board_reset(board);
     return board;
 }
 
+void board_copy(Board *dst, const Board *src) {
+    DAi32 *moves = dst->moves;
+    *dst = *src;
+    dst->moves = moves;
+    dst->moves->size = 0;
+    for (size_t i = 0; i < src->moves->size; ++i) {
+        dai32_push(dst->moves, src->moves->data[i]);
+    }
+}
+
+// Full position key: pieces, side to move, castling rights and the en passant file.
+uint64_t board_key(Board *board) {
+    uint64_t key = board->hash;
+    if (board->to_move == BLACK) {
+        key ^= zobrist_black_to_move;
+    }
+    size_t castling = 0;
+    for (size_t color = 0; color < 2; ++color) {
+        if (board->first_king_move[color] == 0) {
+            castling |= (board->first_king_rook_move[color] == 0) << (2 * color);
+            castling |= (board->first_queen_rook_move[color] == 0) << (2 * color + 1);
+        }
+    }
+    key ^= zobrist_castling[castling];
+    if (board->moves->size > 0) {
+        Move move = move_data_create(*dai32_last_elem(board->moves));
+        if (move.piece_type == PAWN && (move.from ^ move.to) == 16) {
+            key ^= zobrist_en_passant[IDX_X(move.from)];
+        }
+    }
+    return key;
+}
+
 bool is_attacked(Board *board, size_t idx) {
     assert(board->attacked_evaluated);
     return board->attacked & (1ULL << idx);
@@ -344,6 +399,24 @@ void undo_last_move(Board *board) {
     undo_last_move_base(board, true);
 }
 
+void apply_null_move(Board *board) {
+    // A null move is recorded as an empty move so that en passant is not offered afterwards.
+    board->to_move = op_color(board->to_move);
+    ++board->half_move_counter;
+    board->attacked_evaluated = false;
+    board->attacked = 0;
+    dai32_push(board->moves, 0);
+}
+
+void undo_null_move(Board *board) {
+    assert(board->moves->size > 0 && is_move_null(move_data_create(*dai32_last_elem(board->moves))));
+    board->to_move = op_color(board->to_move);
+    --board->half_move_counter;
+    board->attacked_evaluated = false;
+    board->attacked = 0;
+    (void) dai32_pop(board->moves);
+}
+
 size_t n_moves_since_last_pawn_or_capture_move(Board *board) {
     size_t last_pawn_move = max(board->last_pawn_move[WHITE], board->last_pawn_move[BLACK]);
     size_t last_capture_move = max(board->last_capture_move[WHITE], board->last_capture_move[BLACK]);
@@ -890,6 +963,25 @@ void test_undo_last_move(void) {
     }
 }
 
+void test_null_move(void) {
+    Board *board = board_create();
+    const char *fen = "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1";
+    (void) fen_to_board(fen, board);
+
+    apply_null_move(board);
+    DA *da_1 = da_create();
+    char *fen_1 = board_to_fen(board, da_1);
+    assert(strcmp(fen_1, "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 1 2") == 0);
+
+    undo_null_move(board);
+    DA *da_2 = da_create();
+    char *fen_2 = board_to_fen(board, da_2);
+    assert(strcmp(fen_2, fen) == 0);
+
+    da_free(da_1);
+    da_free(da_2);
+}
+
 void test_board_to_fen(void) {
     Board *board = board_create();
     place_initial_pieces(board);
@@ -1083,13 +1175,43 @@ void test_uci_notation_to_move(void) {
     (void)seq;
 }
 
+// The running sums must match a recount after captures, promotions and undos.
+void test_incremental_eval_terms(void) {
+    Board *board = board_create();
+    (void) fen_to_board("r3k3/1P6/8/3p4/4P3/8/8/4K3 w - - 0 1", board);
+    const char *moves[] = {"e4d5", "e8d7", "b7a8q"};
+    for (size_t i = 0; i <= sizeof(moves) / sizeof(moves[0]); ++i) {
+        Score score = 0;
+        int32_t phase = 0;
+        for (size_t idx = 0; idx < 64; ++idx) {
+            Piece piece = board->pieces[idx];
+            score += psqt[piece.type][piece.color][idx];
+            phase += phase_weights[piece.type];
+        }
+        assert(board->psqt_score == score);
+        assert(board->phase == phase);
+        if (i < sizeof(moves) / sizeof(moves[0])) {
+            apply_move(board, uci_notation_to_move(moves[i], board));
+        }
+    }
+    assert(board->phase == phase_weights[QUEEN]);
+    assert(MG_VALUE(board->psqt_score) > 0 && EG_VALUE(board->psqt_score) > 0);
+
+    Board *initial = board_create();
+    place_initial_pieces(initial);
+    assert(initial->phase == PHASE_MAX);
+    assert(initial->psqt_score == 0);
+}
+
 void test_board(void) {
     test_wrapper(test_board_initial);
     test_wrapper(test_board_display);
     test_wrapper(test_apply_move);
     test_wrapper(test_undo_last_move);
+    test_wrapper(test_null_move);
     test_wrapper(test_board_to_fen);
     test_wrapper(test_fen_to_board);
     test_wrapper(test_san_notation_to_move);
     test_wrapper(test_uci_notation_to_move);
+    test_wrapper(test_incremental_eval_terms);
 }
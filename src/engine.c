@@ -2,8 +2,12 @@
 #include <stdlib.h>
 #include <time.h>
 #include <limits.h>
+#include <math.h>
+#include <string.h>
 
 #include "engine.h"
+#include "attacks.h"
+#include "eval.h"
 #include "board.h"
 #include "generate.h"
 #include "common.h"
@@ -15,13 +19,106 @@
 
 #define NEG_INF -10000000LL
 #define POS_INF 10000000LL
+#define MATE_SCORE 1000000LL  // Mate at the root, a mate n plies away scores MATE_SCORE - n
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)
+
+#define MAX_MOVES 256
+#define DEFAULT_SEARCH_DEPTH 5
+#define STOP_POLL_NODES 256  // Power of two
+#define STOP_WAIT_MS 1
+#define CURRMOVE_MIN_TIME_US 1000000  // Root moves are only reported in longer searches
+
+// Aspiration windows
+#define ASPIRATION_MIN_DEPTH 3
+#define ASPIRATION_DELTA 25LL
+#define ASPIRATION_MAX_DELTA 1000LL
+
+// Null move pruning
+#define NULL_MOVE_MIN_DEPTH 2
+#define NULL_MOVE_ADAPTIVE_DEPTH 6
+#define NULL_MOVE_VERIFY_DEPTH 6
+
+// Late move reductions
+#define LMR_MIN_DEPTH 3
+#define LMR_MIN_MOVES 2
+#define LMR_TABLE_DEPTH 64
+#define LMR_TABLE_MOVES 64
+#define LMR_BASE 0.75
+#define LMR_DIVISOR 2.25
+#define LMR_HISTORY_DIVISOR 8192
+
+// Internal iterative reductions
+#define IIR_MIN_DEPTH 4
+
+// Pruning near the horizon
+#define REVERSE_FUTILITY_DEPTH 4
+#define REVERSE_FUTILITY_MARGIN 90LL
+#define FUTILITY_DEPTH 3
+#define FUTILITY_MARGIN 120LL
+#define RAZORING_DEPTH 2
+#define RAZORING_MARGIN 300LL
+#define LATE_MOVE_PRUNING_DEPTH 4
+#define LATE_MOVE_PRUNING_BASE 3
+#define HISTORY_PRUNING_DEPTH 2
+#define HISTORY_PRUNING_MARGIN 2048
+
+// ProbCut
+#define PROBCUT_MIN_DEPTH 5
+#define PROBCUT_MARGIN 200LL
+#define PROBCUT_REDUCTION 4
+#define PROBCUT_TT_DEPTH_MARGIN 3
+
+// Extensions
+#define SINGULAR_MIN_DEPTH 6
+#define SINGULAR_TT_DEPTH_MARGIN 3
+#define SINGULAR_MARGIN 2LL  // Per ply of depth
+
+// Lazy SMP
+#define HELPER_MAX_DEPTH (MAX_PLY - 1)
+
+// Correction history
+#define CORRECTION_GRAIN 256
+#define CORRECTION_WEIGHT_SCALE 256
+#define CORRECTION_MAX_WEIGHT 16
+#define CORRECTION_MAX (64 * CORRECTION_GRAIN)  // Largest correction in centipawns times the grain
+
+// Move ordering
+#define TT_MOVE_SCORE 200000
+#define CAPTURE_SCORE_OFFSET 100000
+#define CAPTURE_VALUE_WEIGHT 16  // Victim value outweighs most of the capture history
+#define KILLER_SCORE_OFFSET 70000
+#define COUNTERMOVE_SCORE_OFFSET 65000  // Above any quiet history sum and pawn threat adjustment
+#define PAWN_THREAT_SCORE 8192  // Quiet piece moves into or out of enemy pawn attacks
+
+size_t lmr_reductions[LMR_TABLE_DEPTH][LMR_TABLE_MOVES];
+
+void init_lmr_reductions(void) {
+    for (size_t depth = 1; depth < LMR_TABLE_DEPTH; ++depth) {
+        for (size_t n = 1; n < LMR_TABLE_MOVES; ++n) {
+            lmr_reductions[depth][n] = (size_t) (LMR_BASE + log((double) depth) * log((double) n) / LMR_DIVISOR);
+        }
+    }
+}
 
 Engine *engine_create(on_score_event_f on_score) {
     Engine *engine = (Engine *) arena_allocate(&arena, sizeof(Engine));
     engine->state = ENGINE_NOT_STARTED;
 	engine->board = NULL;
 	engine->moves = dai32_create();
+    engine->tt = tt_create(TT_DEFAULT_SIZE_MB);
+    engine->eval_cache = eval_cache_create(EVAL_CACHE_DEFAULT_SIZE_MB);
+    engine->threads = NULL;
+    engine->n_threads = 0;
+    memset(engine->thread_boards, 0, sizeof(engine->thread_boards));
+    atomic_init(&engine->stop, false);
+    atomic_init(&engine->pondering, false);
+    engine->ponder_move = (Move) {0};
     engine->on_score = on_score;
+    engine->on_currmove = NULL;
+    engine->multi_pv = 1;
+    engine->random_tie_break = true;
+    time_manager_disable(&engine->time_manager);
+    engine_set_threads(engine, 1);
     return engine;
 }
 
@@ -30,12 +127,79 @@ void engine_start(Engine *engine) {
         srand((unsigned)getpid());
 		// srand(time(NULL));
         // Load engine related data
+        init_lmr_reductions();
         engine->state = ENGINE_READY;
     } else {
         // assert(0);
     }
 }
 
+void engine_set_threads(Engine *engine, size_t n_threads) {
+    assert(engine->state != ENGINE_BUSY);
+    n_threads = max(n_threads, (size_t) 1);
+    n_threads = min(n_threads, (size_t) MAX_THREADS);
+    SearchThread *threads = (SearchThread *) aligned_malloc(CACHE_LINE_SIZE, n_threads * sizeof(SearchThread));
+    if (threads == NULL) {
+        // Keep the current threads rather than search without any.
+        return;
+    }
+    for (size_t i = 0; i < engine->n_threads; ++i) {
+        SearchThread *thread = engine->threads + i;
+        dai32_free(&thread->root_moves);
+        dai32_free(&thread->best_moves);
+    }
+    aligned_free(engine->threads);
+
+    engine->threads = threads;
+    engine->n_threads = n_threads;
+    for (size_t i = 0; i < n_threads; ++i) {
+        SearchThread *thread = engine->threads + i;
+        memset(thread, 0, sizeof(SearchThread));
+        thread->engine = engine;
+        thread->id = i;
+        // Boards live in the arena, so they are created once per thread slot and reused.
+        if (engine->thread_boards[i] == NULL) {
+            engine->thread_boards[i] = board_create();
+        }
+        thread->board = engine->thread_boards[i];
+    }
+}
+
+bool engine_set_hash_size(Engine *engine, size_t size_mb) {
+    assert(engine->state != ENGINE_BUSY);
+    size_mb = max(size_mb, (size_t) 1);
+    size_mb = min(size_mb, (size_t) TT_MAX_SIZE_MB);
+    return tt_resize(engine->tt, size_mb);
+}
+
+bool engine_set_eval_cache_size(Engine *engine, size_t size_mb) {
+    assert(engine->state != ENGINE_BUSY);
+    size_mb = max(size_mb, (size_t) 1);
+    size_mb = min(size_mb, (size_t) EVAL_CACHE_MAX_SIZE_MB);
+    return eval_cache_resize(engine->eval_cache, size_mb);
+}
+
+void engine_set_multi_pv(Engine *engine, size_t multi_pv) {
+    assert(engine->state != ENGINE_BUSY);
+    multi_pv = max(multi_pv, (size_t) 1);
+    multi_pv = min(multi_pv, (size_t) MAX_MULTI_PV);
+    engine->multi_pv = multi_pv;
+}
+
+void engine_new_game(Engine *engine) {
+    assert(engine->state != ENGINE_BUSY);
+    tt_clear(engine->tt);
+    eval_cache_clear(engine->eval_cache);
+    for (size_t i = 0; i < engine->n_threads; ++i) {
+        SearchThread *thread = engine->threads + i;
+        memset(thread->history, 0, sizeof(thread->history));
+        memset(thread->countermoves, 0, sizeof(thread->countermoves));
+        memset(thread->capture_history, 0, sizeof(thread->capture_history));
+        memset(thread->continuation_history, 0, sizeof(thread->continuation_history));
+        memset(thread->correction_history, 0, sizeof(thread->correction_history));
+    }
+}
+
 typedef struct MoveH {
     uint32_t move_data;
     int32_t score;
@@ -53,7 +217,39 @@ int cmp_moveh(const void *a, const void *b) {
     }
 }
 
-void sort_moves(DAi32 *moves) {
+bool is_quiet(Move move) {
+    return !move_is_type_of(move, CAPTURE | PROMOTION);
+}
+
+// Move played plies_back plies before the current position, null if there is none
+// or it was a null move.
+Move previous_move(Board *board, size_t plies_back) {
+    if (board->moves->size < plies_back) {
+        return (Move) {0};
+    }
+    return move_data_create(board->moves->data[board->moves->size - plies_back]);
+}
+
+// Quiet history of move in the current position: its own history plus how well it did
+// after the moves played one and two plies earlier.
+int32_t quiet_history(SearchThread *thread, Move move) {
+    int32_t score = thread->history[move.piece_color][move.from][move.to];
+    for (size_t i = 0; i < CONTINUATION_PLIES; ++i) {
+        Move prev = previous_move(thread->board, i + 1);
+        if (!is_move_null(prev)) {
+            score += thread->continuation_history[i][prev.piece_color][prev.piece_type][prev.to]
+                [move.piece_color][move.piece_type][move.to];
+        }
+    }
+    return score;
+}
+
+uint32_t countermove(SearchThread *thread) {
+    Move prev = previous_move(thread->board, 1);
+    return is_move_null(prev) ? 0 : thread->countermoves[prev.piece_color][prev.piece_type][prev.to];
+}
+
+void sort_moves(SearchThread *thread, DAi32 *moves, size_t ply, uint16_t tt_move) {
 	static const int64_t piece_vals[] = {
 		[PAWN] = 100LL,
 		[KNIGHT] = 300LL,
@@ -63,16 +259,44 @@ void sort_moves(DAi32 *moves) {
 		[KING] = 0LL,
 		[NONE] = 0LL,
 	};
-    MoveH *movehs = arena_allocate(&arena, sizeof(MoveH) * moves->size);
+    MoveH movehs[MAX_MOVES];
+    assert(moves->size <= MAX_MOVES);
+    uint32_t counter = countermove(thread);
+    // Attack maps left by the evaluation of this node, if it was evaluated.
+    const AttackMaps *maps = thread->attack_maps + ply;
+    if (maps->key != board_key(thread->board)) {
+        maps = NULL;
+    }
     for (size_t i = 0; i < moves->size; ++i) {
         Move move = move_data_create(moves->data[i]);
         movehs[i].move_data = moves->data[i];
         movehs[i].score = 0;
+        if (tt_move_matches(tt_move, move)) {
+            movehs[i].score = TT_MOVE_SCORE;
+            continue;
+        }
+        if (is_quiet(move)) {
+            if (moves->data[i] == thread->killers[ply][0] || moves->data[i] == thread->killers[ply][1]) {
+                movehs[i].score = KILLER_SCORE_OFFSET;
+            } else if (moves->data[i] == counter) {
+                movehs[i].score = COUNTERMOVE_SCORE_OFFSET;
+            } else {
+                movehs[i].score = quiet_history(thread, move);
+                if (maps != NULL && move.piece_type != PAWN) {
+                    uint64_t pawn_threats = maps->by_type[PAWN][!move.piece_color];
+                    movehs[i].score -= PAWN_THREAT_SCORE * (int32_t) ((pawn_threats >> move.to) & 1);
+                    movehs[i].score += PAWN_THREAT_SCORE * (int32_t) ((pawn_threats >> move.from) & 1);
+                }
+            }
+            continue;
+        }
+        movehs[i].score = CAPTURE_SCORE_OFFSET
+            + thread->capture_history[move.piece_color][move.piece_type][move.to][move.captured_type];
         if (move_is_type_of(move, CAPTURE)) {
-            movehs[i].score += piece_vals[move.captured_type];
+            movehs[i].score += CAPTURE_VALUE_WEIGHT * piece_vals[move.captured_type];
         }
         if (move_is_type_of(move, PROMOTION)) {
-            movehs[i].score += piece_vals[move.promoted_type] - piece_vals[PAWN];
+            movehs[i].score += CAPTURE_VALUE_WEIGHT * (piece_vals[move.promoted_type] - piece_vals[PAWN]);
         }
     }
     qsort(movehs, moves->size, sizeof(movehs[0]), cmp_moveh);
@@ -82,156 +306,881 @@ void sort_moves(DAi32 *moves) {
     }
 }
 
-int64_t evaluate_board(Engine *engine, size_t n_moves) {
-	static const int64_t piece_vals[] = {
-		[PAWN] = 100LL,
-		[KNIGHT] = 320LL,
-		[BISHOP] = 330LL,
-		[ROOK] = 500LL,
-		[QUEEN] = 900LL,
-		[KING] = 0LL,
-		[NONE] = 0LL,
-	};
-	if (n_moves == 0) {
-		if (is_king_in_check(engine->board)) {
-            //for (size_t i = 0; i < engine->board->moves->size; ++i) {
-            //    print_move(move_data_create(engine->board->moves->data[i]));
-            //    printf(" ");
-            //}
-            //printf("\n");
-			return -1000000LL;
-		} else {
-			return 0LL;
-		}
-	}
-	size_t half_move_clock = n_moves_since_last_pawn_or_capture_move(engine->board);
-	if (half_move_clock >= 50) {
-		return 0LL;
-	}
-	int64_t eval = 0LL;
-	for (size_t i = 0; i < 64; ++i) {
-		Piece *piece = engine->board->pieces + i;
-		int fac = (piece->data != 0) * (2  * (piece->color == engine->board->to_move) - 1);
-		eval += fac * (piece_vals[piece->type] + piece_val_offsets[piece->type][piece->color][i]);
-	}
-    
-    bool end_game = false;
-    if (engine->board->bb[QUEEN][WHITE] == 0 && engine->board->bb[QUEEN][BLACK] == 0) {
-        end_game = true;
+// Score of a position without legal moves. ply is the distance from the root, so that
+// a nearer mate scores higher.
+int64_t no_moves_score(bool in_check, size_t ply) {
+    return in_check ? -MATE_SCORE + (int64_t) ply : 0LL;
+}
+
+size_t count_non_pawn_pieces(Board *board, Color color) {
+    return count_pieces(board, KNIGHT, color)
+        + count_pieces(board, BISHOP, color)
+        + count_pieces(board, ROOK, color)
+        + count_pieces(board, QUEEN, color);
+}
+
+// Gravity update: the bonus shrinks as the entry approaches HISTORY_MAX, keeping it bounded.
+void update_history(int32_t *entry, int32_t bonus) {
+    int32_t abs_bonus = bonus < 0 ? -bonus : bonus;
+    *entry += bonus - (int32_t) ((int64_t) *entry * abs_bonus / HISTORY_MAX);
+}
+
+void update_quiet_histories(SearchThread *thread, Move move, int32_t bonus) {
+    update_history(&thread->history[move.piece_color][move.from][move.to], bonus);
+    for (size_t i = 0; i < CONTINUATION_PLIES; ++i) {
+        Move prev = previous_move(thread->board, i + 1);
+        if (!is_move_null(prev)) {
+            update_history(&thread->continuation_history[i][prev.piece_color][prev.piece_type][prev.to]
+                [move.piece_color][move.piece_type][move.to], bonus);
+        }
+    }
+}
+
+int32_t *capture_history_entry(SearchThread *thread, Move move) {
+    return &thread->capture_history[move.piece_color][move.piece_type][move.to][move.captured_type];
+}
+
+// Rewards the move that caused a beta cutoff and penalises the n_tried moves searched before it,
+// which failed to refute. Pruned or excluded moves were never tried and must not be passed.
+void update_cutoff_stats(SearchThread *thread, Move best_move, size_t ply, size_t depth, const uint32_t *tried, size_t n_tried) {
+    size_t bonus_size = min(depth * depth, (size_t) HISTORY_MAX);
+    int32_t bonus = (int32_t) bonus_size;
+    if (is_quiet(best_move)) {
+        if (thread->killers[ply][0] != best_move.data) {
+            thread->killers[ply][1] = thread->killers[ply][0];
+            thread->killers[ply][0] = best_move.data;
+        }
+        Move prev = previous_move(thread->board, 1);
+        if (!is_move_null(prev)) {
+            thread->countermoves[prev.piece_color][prev.piece_type][prev.to] = best_move.data;
+        }
+        update_quiet_histories(thread, best_move, bonus);
     } else {
-        if (engine->board->bb[QUEEN][WHITE] > 0 
-                && count_pieces(engine->board, ROOK, WHITE) 
-                    + count_pieces(engine->board, BISHOP, WHITE) 
-                    + count_pieces(engine->board, KNIGHT, WHITE) == 1) {
-            end_game = true;
+        update_history(capture_history_entry(thread, best_move), bonus);
+    }
+    for (size_t i = 0; i < n_tried; ++i) {
+        Move move = move_data_create(tried[i]);
+        if (!is_quiet(move)) {
+            update_history(capture_history_entry(thread, move), -bonus);
+        } else if (is_quiet(best_move)) {
+            update_quiet_histories(thread, move, -bonus);
+        }
+    }
+}
+
+bool is_mate_score(int64_t score) {
+    return score >= MATE_BOUND || score <= -MATE_BOUND;
+}
+
+int32_t *correction_entry(SearchThread *thread, Board *board) {
+    return &thread->correction_history[board->to_move][board->pawn_hash & (CORRECTION_HISTORY_SIZE - 1)];
+}
+
+// Static eval shifted by the error it has shown in this pawn structure, kept clear of mate scores.
+int64_t corrected_eval(SearchThread *thread, Board *board, int64_t eval) {
+    eval += *correction_entry(thread, board) / CORRECTION_GRAIN;
+    eval = max(eval, -MATE_BOUND + 1);
+    return min(eval, MATE_BOUND - 1);
+}
+
+// Moves the entry towards error, the search score minus the raw static eval, faster for deeper searches.
+void update_correction_history(SearchThread *thread, Board *board, size_t depth, int64_t error) {
+    int32_t *entry = correction_entry(thread, board);
+    int64_t weight = (int64_t) min(depth + 1, (size_t) CORRECTION_MAX_WEIGHT);
+    int64_t value = (*entry * (CORRECTION_WEIGHT_SCALE - weight) + error * CORRECTION_GRAIN * weight) / CORRECTION_WEIGHT_SCALE;
+    value = max(value, (int64_t) -CORRECTION_MAX);
+    value = min(value, (int64_t) CORRECTION_MAX);
+    *entry = (int32_t) value;
+}
+
+// Mate scores are relative to the root, the table stores them relative to the node
+// so that they stay valid when the position is reached at another ply.
+int64_t score_to_tt(int64_t score, size_t ply) {
+    if (score >= MATE_BOUND) {
+        return score + (int64_t) ply;
+    }
+    if (score <= -MATE_BOUND) {
+        return score - (int64_t) ply;
+    }
+    return score;
+}
+
+int64_t score_from_tt(int64_t score, size_t ply) {
+    if (score >= MATE_BOUND) {
+        return score - (int64_t) ply;
+    }
+    if (score <= -MATE_BOUND) {
+        return score + (int64_t) ply;
+    }
+    return score;
+}
+
+// Full moves to mate, negative when getting mated and 0 for a normal score.
+int64_t mate_in_moves(int64_t score) {
+    if (score >= MATE_BOUND) {
+        return (MATE_SCORE - score + 1) / 2;
+    }
+    if (score <= -MATE_BOUND) {
+        return -(MATE_SCORE + score) / 2;
+    }
+    return 0;
+}
+
+bool should_stop(SearchThread *thread) {
+    return thread->stopped;
+}
+
+// Whether the main thread has done what the search limits ask for. Nothing is enough
+// for an infinite search or while pondering. The soft time limit is only checked
+// between iterations, the hard one also while searching.
+bool limits_reached(SearchThread *thread, bool iteration_done) {
+    Engine *engine = thread->engine;
+    if (engine->limits.infinite || atomic_load_explicit(&engine->pondering, memory_order_relaxed)) {
+        return false;
+    }
+    SearchLimits *limits = &engine->limits;
+    TimeManager *tm = &engine->time_manager;
+    if (time_manager_hard_exceeded(tm) || (iteration_done && time_manager_soft_exceeded(tm))) {
+        return true;
+    }
+    if (limits->nodes > 0 && engine_nodes(engine) >= limits->nodes) {
+        return true;
+    }
+    // The default depth only applies when nothing else bounds the search.
+    size_t depth = limits->depth;
+    if (depth == 0 && limits->nodes == 0 && !tm->enabled) {
+        depth = DEFAULT_SEARCH_DEPTH;
+    }
+    return depth > 0 && thread->completed_depth >= depth;
+}
+
+// Counts the node and polls the shared stop flag every STOP_POLL_NODES nodes.
+void count_node(SearchThread *thread, size_t ply) {
+    if (thread->stopped) {
+        return;
+    }
+    // Only this thread writes the counter, so a relaxed load and store is enough.
+    size_t nodes = atomic_load_explicit(&thread->nodes, memory_order_relaxed) + 1;
+    atomic_store_explicit(&thread->nodes, nodes, memory_order_relaxed);
+    if (ply + 1 > thread->stats.seldepth) {
+        thread->stats.seldepth = ply + 1;
+    }
+    // Polling at the exact node limit keeps single threaded node limited searches reproducible.
+    if ((nodes & (STOP_POLL_NODES - 1)) == 0 || nodes == thread->engine->limits.nodes) {
+        if (thread->id == 0 && limits_reached(thread, false)) {
+            engine_stop(thread->engine);
         }
-        if (engine->board->bb[QUEEN][BLACK] > 0 
-                && count_pieces(engine->board, ROOK, BLACK) 
-                    + count_pieces(engine->board, BISHOP, BLACK) 
-                    + count_pieces(engine->board, KNIGHT, BLACK) == 1) {
-            end_game = true;
+        thread->stopped = atomic_load_explicit(&thread->engine->stop, memory_order_relaxed);
+    }
+}
+
+// Makes move followed by the line found below it the best line from ply on.
+void update_pv(SearchThread *thread, size_t ply, Move move) {
+    size_t child_length = thread->pv_length[ply + 1];
+    thread->pv[ply][ply] = move.data;
+    for (size_t i = ply + 1; i < child_length; ++i) {
+        thread->pv[ply][i] = thread->pv[ply + 1][i];
+    }
+    thread->pv_length[ply] = child_length > ply + 1 ? child_length : ply + 1;
+}
+
+// Quiescence search: only captures and promotions are expanded (all moves when in check),
+// so the static evaluation is only trusted in quiet positions.
+int64_t quiesce(SearchThread *thread, size_t ply, int64_t alpha, int64_t beta) {
+    thread->pv_length[ply] = ply;
+    count_node(thread, ply);
+    ++thread->stats.qnodes;
+    if (should_stop(thread)) {
+        return 0;
+    }
+    Board *board = thread->board;
+    bool in_check = is_king_in_check(board);
+    DAi32 moves = {0};
+    // Out of check only captures and promotions are searched, so quiet moves are never
+    // generated; a legal quiet move is only looked for when there is no capture (stalemate).
+    if (in_check) {
+        generate_moves(board, &moves);
+    } else {
+        generate_captures(board, &moves);
+    }
+    if (moves.size == 0 && (in_check || !has_legal_move(board))) {
+        return no_moves_score(in_check, ply);
+    }
+
+    int64_t value = NEG_INF;
+    if (!in_check || ply >= MAX_PLY - 1) {
+        value = evaluate_board(board, thread->engine->eval_cache, &thread->pawn_table, &thread->attack_maps[ply], alpha, beta);
+        if (value >= beta || moves.size == 0 || ply >= MAX_PLY - 1) {
+            dai32_free(&moves);
+            return value;
         }
+        alpha = max(alpha, value);
     }
-    if (end_game) {
-        int fac = 0;
-        size_t king_idx = 0;
+    sort_moves(thread, &moves, ply, 0);
 
-        // WHITE
-        fac = 2 * (WHITE == engine->board->to_move) - 1;
-        king_idx = get_king_idx(engine->board, WHITE);
-        eval += fac * end_game_king_val_offsets[WHITE][king_idx];
+    for (size_t i = 0; i < moves.size; ++i) {
+        Move move = move_data_create(moves.data[i]);
+        apply_move(board, move);
+        int64_t eval = -quiesce(thread, ply + 1, -beta, -alpha);
+        undo_last_move(board);
+        if (should_stop(thread)) {
+            break;
+        }
 
-        // BLACK
-        fac = 2 * (BLACK == engine->board->to_move) - 1;
-        king_idx = get_king_idx(engine->board, BLACK);
-        eval += fac * end_game_king_val_offsets[BLACK][king_idx];
+        value = max(value, eval);
+        alpha = max(alpha, value);
+        if (alpha >= beta) {
+            break;
+        }
     }
 
-	return eval;
+    dai32_free(&moves);
+    return value;
 }
 
-int64_t alphabeta(Engine *engine, size_t depth, int64_t alpha, int64_t beta, bool is_root_color) {
-    DAi32 *moves = dai32_create();
-    generate_moves(engine->board, moves);
-    //sort_moves(moves);
-    
-    if (depth == 0 || moves->size == 0) {
-        int64_t eval = evaluate_board(engine, moves->size);
-        dai32_free(moves);
-        return eval;
+int64_t alphabeta(SearchThread *thread, size_t depth, size_t ply, int64_t alpha, int64_t beta, bool allow_null, bool cut_node) {
+    if (depth == 0) {
+        return quiesce(thread, ply, alpha, beta);
+    }
+    thread->pv_length[ply] = ply;
+    count_node(thread, ply);
+    if (should_stop(thread)) {
+        return 0;
+    }
+    Board *board = thread->board;
+    bool pv_node = beta - alpha > 1;
+
+    // Mate distance pruning: no line from here beats a mate already found closer to the root.
+    int64_t mated_score = -MATE_SCORE + (int64_t) ply;
+    int64_t mating_score = MATE_SCORE - (int64_t) ply - 1;
+    alpha = max(alpha, mated_score);
+    beta = min(beta, mating_score);
+    if (alpha >= beta) {
+        return alpha;
+    }
+    int64_t original_alpha = alpha;
+    // In a singular search the TT move is left out, so neither the table nor pruning that
+    // assumes the full move list can be trusted.
+    uint32_t excluded_move = thread->excluded_moves[ply];
+    bool singular_search = excluded_move != 0;
+
+    uint64_t key = board_key(board);
+    TTData tt_data = {0};
+    bool tt_hit = !singular_search && tt_probe(thread->engine->tt, key, &tt_data);
+    thread->stats.tt_hits += tt_hit;
+    int64_t tt_score = tt_hit ? score_from_tt(tt_data.score, ply) : 0;
+    if (tt_hit && !pv_node && tt_data.depth >= depth) {
+        if (tt_data.bound == TT_EXACT
+                || (tt_data.bound == TT_LOWER && tt_score >= beta)
+                || (tt_data.bound == TT_UPPER && tt_score <= alpha)) {
+            return tt_score;
+        }
+    }
+
+    bool in_check = is_king_in_check(board);
+    if (ply >= MAX_PLY - 1) {
+        return has_legal_move(board) ? evaluate_board(board, thread->engine->eval_cache, &thread->pawn_table, &thread->attack_maps[ply], alpha, beta) : no_moves_score(in_check, ply);
+    }
+    // Pruning decisions use the static eval corrected for this pawn structure's known bias.
+    // Their margins and the correction itself need the full eval, so nothing is lazy here.
+    int64_t raw_eval = in_check ? NEG_INF : evaluate_board(board, thread->engine->eval_cache, &thread->pawn_table, &thread->attack_maps[ply], NEG_INF, POS_INF);
+    int64_t static_eval = in_check ? NEG_INF : corrected_eval(thread, board, raw_eval);
+
+    // Reverse futility pruning: far enough above beta that a quiet move is not expected to lose it all.
+    if (!pv_node
+            && !in_check
+            && !singular_search
+            && depth <= REVERSE_FUTILITY_DEPTH
+            && !is_mate_score(beta)
+            && static_eval - REVERSE_FUTILITY_MARGIN * (int64_t) depth >= beta) {
+        return static_eval;
     }
+
+    // Razoring: hopelessly below alpha, so only captures can save the node.
+    if (!pv_node
+            && !in_check
+            && !singular_search
+            && depth <= RAZORING_DEPTH
+            && static_eval + RAZORING_MARGIN * (int64_t) depth < alpha) {
+        int64_t eval = quiesce(thread, ply, alpha, alpha + 1);
+        if (eval <= alpha) {
+            return eval;
+        }
+    }
+
+    // Futility pruning: quiet moves cannot lift the eval above alpha this close to the horizon.
+    bool futile = !pv_node
+        && !in_check
+        && depth <= FUTILITY_DEPTH
+        && !is_mate_score(alpha)
+        && static_eval + FUTILITY_MARGIN * (int64_t) depth <= alpha;
+
+    // Null move pruning: if passing still fails high, a real move almost certainly does too.
+    // Not tried in PV nodes, in check, twice in a row or with only pawns, where zugzwang is common.
+    size_t non_pawn_pieces = count_non_pawn_pieces(board, board->to_move);
+    if (allow_null
+            && !pv_node
+            && !singular_search
+            && depth >= NULL_MOVE_MIN_DEPTH
+            && non_pawn_pieces > 0
+            && !in_check
+            && !is_mate_score(beta)
+            && static_eval >= beta) {
+        size_t reduction = depth > NULL_MOVE_ADAPTIVE_DEPTH ? 3 : 2;
+        size_t null_depth = depth > reduction ? depth - reduction - 1 : 0;
+
+        apply_null_move(board);
+        int64_t null_eval = -alphabeta(thread, null_depth, ply + 1, -beta, -beta + 1, false, !cut_node);
+        undo_null_move(board);
+
+        if (null_eval >= beta) {
+            // With a single piece left zugzwang is likely, and deep cutoffs are costly when wrong,
+            // so confirm the cutoff with a reduced search of our own moves.
+            bool verify = non_pawn_pieces <= 1 || depth >= NULL_MOVE_VERIFY_DEPTH;
+            if (!verify || alphabeta(thread, depth - reduction, ply, beta - 1, beta, false, false) >= beta) {
+                // Beta, never null_eval: passing cannot prove a mate.
+                return beta;
+            }
+        }
+    }
+    // ProbCut: a capture that beats beta by a margin in a reduced search would almost certainly
+    // beat beta in the full one. Only captures whose exchange already covers the margin are
+    // tried, each first against quiescence and then confirmed with the reduced search.
+    int64_t probcut_beta = beta + PROBCUT_MARGIN;
+    if (!pv_node
+            && !in_check
+            && !singular_search
+            && depth >= PROBCUT_MIN_DEPTH
+            && !is_mate_score(beta)
+            && !(tt_hit && (size_t) tt_data.depth + PROBCUT_TT_DEPTH_MARGIN >= depth && tt_score < probcut_beta)) {
+        DAi32 captures = {0};
+        generate_captures(board, &captures);
+        sort_moves(thread, &captures, ply, tt_hit ? (uint16_t) tt_data.move : 0);
+        int64_t probcut_eval = NEG_INF;
+        Move probcut_move = (Move) {0};
+        for (size_t i = 0; i < captures.size; ++i) {
+            Move move = move_data_create(captures.data[i]);
+            if (!see_ge(board, move, probcut_beta - static_eval)) {
+                continue;
+            }
+            apply_move(board, move);
+            int64_t eval = -quiesce(thread, ply + 1, -probcut_beta, -probcut_beta + 1);
+            if (eval >= probcut_beta) {
+                eval = -alphabeta(thread, depth - PROBCUT_REDUCTION, ply + 1, -probcut_beta, -probcut_beta + 1, true, !cut_node);
+            }
+            undo_last_move(board);
+            if (should_stop(thread)) {
+                break;
+            }
+            if (eval >= probcut_beta) {
+                probcut_eval = eval;
+                probcut_move = move;
+                break;
+            }
+        }
+        dai32_free(&captures);
+        if (probcut_eval != NEG_INF) {
+            tt_store(thread->engine->tt, key, probcut_move, score_to_tt(probcut_eval, ply),
+                     depth - PROBCUT_TT_DEPTH_MARGIN, TT_LOWER);
+            return probcut_eval;
+        }
+    }
+
+    // Moves are only generated once the node is expanded, the pruning above does not need them.
+    DAi32 moves = {0};
+    generate_moves(board, &moves);
+    if (moves.size == 0) {
+        return no_moves_score(in_check, ply);
+    }
+
+    // Along the previous iteration's PV its move goes first, even if the TT entry was replaced.
+    uint16_t hash_move = tt_hit ? (uint16_t) tt_data.move : 0;
+    if (thread->follow_pv && ply < thread->best_pv_length) {
+        hash_move = tt_pack_move(move_data_create(thread->best_pv[ply]));
+    }
+
+    // Internal iterative reduction: without a hash move the ordering is poor, so an expected
+    // PV or cut node is searched a ply shallower, which also leaves a move for the next visit.
+    if (hash_move == 0 && (pv_node || cut_node) && !singular_search && depth >= IIR_MIN_DEPTH) {
+        --depth;
+    }
+    sort_moves(thread, &moves, ply, hash_move);
     
     int64_t value = NEG_INF;
+    Move best_move = (Move) {0};
+    size_t n_searched = 0;
+    uint32_t searched[MAX_MOVES];  // Moves actually searched, for the history penalties
     
-    for (size_t i = 0; i < moves->size; ++i) {
-        Move move = move_data_create(moves->data[i]);
-        apply_move(engine->board, move);
+    for (size_t i = 0; i < moves.size; ++i) {
+        Move move = move_data_create(moves.data[i]);
+        if (move.data == excluded_move) {
+            continue;
+        }
+        bool is_killer = move.data == thread->killers[ply][0] || move.data == thread->killers[ply][1];
+
+        // Once a move that does not get us mated is found, late or historically bad quiet moves
+        // at low depth are not worth searching at all.
+        if (!pv_node && !in_check && is_quiet(move) && value > -MATE_BOUND) {
+            if (depth <= LATE_MOVE_PRUNING_DEPTH && i >= LATE_MOVE_PRUNING_BASE + depth * depth) {
+                continue;
+            }
+            if (depth <= HISTORY_PRUNING_DEPTH
+                    && !is_killer
+                    && thread->history[move.piece_color][move.from][move.to] < -HISTORY_PRUNING_MARGIN * (int32_t) depth) {
+                continue;
+            }
+        }
+
+        // Extensions are capped per path so that a line cannot grow past twice the root depth.
+        size_t extension = 0;
+        bool can_extend = thread->path_extensions < thread->root_depth;
+
+        // Singular extension: if every other move fails well below the TT score at reduced depth,
+        // the TT move is the only good one and deserves a deeper look.
+        if (can_extend
+                && !singular_search
+                && ply > 0
+                && depth >= SINGULAR_MIN_DEPTH
+                && tt_hit
+                && tt_move_matches((uint16_t) tt_data.move, move)
+                && (tt_data.bound == TT_LOWER || tt_data.bound == TT_EXACT)
+                && (size_t) tt_data.depth + SINGULAR_TT_DEPTH_MARGIN >= depth
+                && !is_mate_score(tt_score)) {
+            int64_t singular_beta = tt_score - SINGULAR_MARGIN * (int64_t) depth;
+            bool follow_pv = thread->follow_pv;
+            thread->follow_pv = false;
+            thread->excluded_moves[ply] = move.data;
+            int64_t singular_eval = alphabeta(thread, (depth - 1) / 2, ply, singular_beta - 1, singular_beta, false, cut_node);
+            thread->excluded_moves[ply] = 0;
+            thread->follow_pv = follow_pv;
+            if (singular_eval < singular_beta) {
+                extension = 1;
+            }
+        }
+
+        apply_move(board, move);
+        bool gives_check = is_king_in_check(board);
+
+        if (futile && i > 0 && is_quiet(move) && !gives_check) {
+            undo_last_move(board);
+            continue;
+        }
+
+        // Check extension: forcing lines are resolved before the horizon.
+        if (can_extend && gives_check) {
+            extension = 1;
+        }
+        size_t new_depth = depth - 1 + extension;
+        thread->path_extensions += extension;
         
-        value = max(value, -alphabeta(engine, depth - 1, -beta, -alpha, !is_root_color));
+        int64_t eval;
+        if (n_searched == 0) {
+            eval = -alphabeta(thread, new_depth, ply + 1, -beta, -alpha, true, !pv_node && !cut_node);
+        } else {
+            // Late move reductions: quiet moves late in the ordering rarely raise alpha,
+            // so search them shallower first and only re-search at full depth if they do.
+            size_t reduction = 0;
+            if (depth >= LMR_MIN_DEPTH && i >= LMR_MIN_MOVES && is_quiet(move) && !is_killer && extension == 0) {
+                size_t lmr_depth = min(depth, (size_t) LMR_TABLE_DEPTH - 1);
+                size_t lmr_moves = min(i, (size_t) LMR_TABLE_MOVES - 1);
+                int64_t r = (int64_t) lmr_reductions[lmr_depth][lmr_moves];
+                r -= pv_node;
+                r -= in_check || gives_check;
+                r -= thread->history[move.piece_color][move.from][move.to] / LMR_HISTORY_DIVISOR;
+                if (r > 0) {
+                    reduction = min((size_t) r, new_depth - 1);
+                }
+            }
+
+            // Principal variation search: prove the move is worse with a null window,
+            // and re-search with the full window only when it is not.
+            eval = -alphabeta(thread, new_depth - reduction, ply + 1, -alpha - 1, -alpha, true, true);
+            if (reduction > 0 && eval > alpha) {
+                eval = -alphabeta(thread, new_depth, ply + 1, -alpha - 1, -alpha, true, !cut_node);
+            }
+            if (eval > alpha && eval < beta) {
+                eval = -alphabeta(thread, new_depth, ply + 1, -beta, -alpha, true, false);
+            }
+        }
         
-        undo_last_move(engine->board);
+        thread->path_extensions -= extension;
+        undo_last_move(board);
+        if (should_stop(thread)) {
+            break;
+        }
+        searched[n_searched++] = move.data;
+        // Only the first move searched can continue the previous PV.
+        thread->follow_pv = false;
         
+        if (eval > value) {
+            value = eval;
+            best_move = move;
+        }
+        if (pv_node && eval > alpha) {
+            update_pv(thread, ply, move);
+        }
         alpha = max(alpha, value);
         if (alpha >= beta) {
+            ++thread->stats.beta_cutoffs;
+            thread->stats.first_move_cutoffs += n_searched == 1;
+            update_cutoff_stats(thread, move, ply, depth, searched, n_searched - 1);
             break;
         }
     }
     
-    dai32_free(moves);
+    dai32_free(&moves);
+    // Only the excluded move was left, so every other move fails low.
+    if (value == NEG_INF) {
+        return alpha;
+    }
+    if (!should_stop(thread) && !singular_search) {
+        TTBound bound = value >= beta ? TT_LOWER : (value > original_alpha ? TT_EXACT : TT_UPPER);
+        tt_store(thread->engine->tt, key, best_move, score_to_tt(value, ply), depth, bound);
+
+        // A bound only tells how far off the static eval was when it points away from it.
+        // Captures are left out, their score is mostly material the eval cannot see.
+        if (!in_check
+                && (is_move_null(best_move) || is_quiet(best_move))
+                && !is_mate_score(value)
+                && !(bound == TT_LOWER && value <= static_eval)
+                && !(bound == TT_UPPER && value >= static_eval)) {
+            update_correction_history(thread, board, depth, value - raw_eval);
+        }
+    }
     return value;
 }
 
-Move engine_best_move(Engine *engine, Board *board) {
+// Searches the root moves from index first on within (alpha, beta) and collects every move
+// sharing the best score. Moves before first are lines already found in this iteration.
+int64_t search_root(SearchThread *thread, size_t depth, size_t first, int64_t alpha, int64_t beta, DAi32 *best_moves) {
+    Engine *engine = thread->engine;
+    Board *board = thread->board;
+    int64_t best_eval = NEG_INF;
+    best_moves->size = 0;
+    thread->pv_length[0] = 0;
+
+    for (size_t i = first; i < thread->root_moves.size; ++i) {
+        Move move = move_data_create(thread->root_moves.data[i]);
+        if (thread->id == 0
+                && engine->on_currmove != NULL
+                && time_now() - engine->start_time >= CURRMOVE_MIN_TIME_US) {
+            engine->on_currmove(move, i + 1, depth);
+        }
+        apply_move(board, move);
+        // The best line's first move is kept in front, so its PV can be followed.
+        thread->follow_pv = first == 0 && i == 0 && thread->best_pv_length > 0 && thread->best_pv[0] == move.data;
+
+        int64_t eval;
+        if (i == first) {
+            eval = -alphabeta(thread, depth - 1, 1, -beta, -alpha, true, false);
+        } else {
+            // Once the best score is exact, test against one below it so that equal moves
+            // are re-searched and kept for the random tie-break.
+            int64_t floor = alpha - (best_eval == alpha);
+            eval = -alphabeta(thread, depth - 1, 1, -floor - 1, -floor, true, true);
+            if (eval > floor && eval < beta) {
+                eval = -alphabeta(thread, depth - 1, 1, -beta, -floor, true, false);
+            }
+        }
+
+        undo_last_move(board);
+        thread->follow_pv = false;
+        if (should_stop(thread)) {
+            break;
+        }
+
+        if (eval > best_eval) {
+            best_moves->size = 0;
+            best_eval = eval;
+            dai32_push(best_moves, move.data);
+            update_pv(thread, 0, move);
+        } else if (eval == best_eval) {
+            dai32_push(best_moves, move.data);
+        }
+        alpha = max(alpha, best_eval);
+        if (best_eval >= beta) {
+            break;
+        }
+    }
+    return best_eval;
+}
+
+// Searches the root moves from index first on with an aspiration window around the
+// score the line had in the previous iteration, widening it on fail high or low.
+int64_t aspiration_search(SearchThread *thread, size_t depth, size_t first, DAi32 *best_moves) {
+    int64_t alpha = NEG_INF;
+    int64_t beta = POS_INF;
+    int64_t delta = ASPIRATION_DELTA;
+    if (thread->completed_depth > 0 && depth >= ASPIRATION_MIN_DEPTH) {
+        alpha = thread->pv_evals[first] - delta;
+        beta = thread->pv_evals[first] + delta;
+    }
+
+    int64_t eval = NEG_INF;
+    while (!should_stop(thread)) {
+        eval = search_root(thread, depth, first, alpha, beta, best_moves);
+        if (eval <= alpha && alpha > NEG_INF) {
+            beta = (alpha + beta) / 2;
+            alpha = eval - delta;
+        } else if (eval >= beta && beta < POS_INF) {
+            beta = eval + delta;
+        } else {
+            break;
+        }
+        delta += delta / 2;
+        if (delta > ASPIRATION_MAX_DELTA) {
+            alpha = NEG_INF;
+            beta = POS_INF;
+        }
+    }
+    return eval;
+}
+
+// Moves the given root move to index position so that it keeps its line in the next iteration.
+void move_to_position(DAi32 *moves, uint32_t move_data, size_t position) {
+    for (size_t i = position; i < moves->size; ++i) {
+        if (moves->data[i] == move_data) {
+            for (; i > position; --i) {
+                moves->data[i] = moves->data[i - 1];
+            }
+            moves->data[position] = move_data;
+            return;
+        }
+    }
+}
+
+void iterative_deepening(SearchThread *thread) {
+    Engine *engine = thread->engine;
+    bool is_main = thread->id == 0;
+    size_t max_depth = HELPER_MAX_DEPTH;
+    // Odd helpers run one ply ahead so that the threads spread over neighbouring depths
+    // and fill the shared table with entries the others can use.
+    size_t depth_offset = thread->id % 2;
+    // Helpers only look for the best move, the extra lines are reported by the main thread.
+    size_t n_lines = is_main ? engine->multi_pv : 1;
+    if (n_lines > thread->root_moves.size) {
+        n_lines = thread->root_moves.size;
+    }
+    DAi32 best_moves = {0};
+    uint32_t previous_best_move = 0;
+
+    for (size_t depth = 1 + depth_offset; depth <= max_depth && thread->root_moves.size > 0; ++depth) {
+        thread->root_depth = depth;
+        // Line i is the best of the root moves not already found by lines 0 to i - 1.
+        // The rounds share the transposition table, so the later ones are mostly cheap.
+        for (size_t line = 0; line < n_lines; ++line) {
+            int64_t eval = aspiration_search(thread, depth, line, &best_moves);
+            if (should_stop(thread)) {
+                break;
+            }
+
+            if (line == 0) {
+                thread->best_moves.size = 0;
+                for (size_t i = 0; i < best_moves.size; ++i) {
+                    dai32_push(&thread->best_moves, best_moves.data[i]);
+                }
+                memcpy(thread->best_pv, thread->pv[0], thread->pv_length[0] * sizeof(thread->pv[0][0]));
+                thread->best_pv_length = thread->pv_length[0];
+                thread->best_eval = eval;
+            }
+            thread->pv_evals[line] = eval;
+            move_to_position(&thread->root_moves, best_moves.data[0], line);
+            if (is_main && engine->on_score != NULL) {
+                size_t nodes = engine_nodes(engine);
+                size_t time_us = (size_t) (time_now() - engine->start_time);
+                SearchInfo info = {
+                    .depth = depth,
+                    .seldepth = thread->stats.seldepth,
+                    .multi_pv = line + 1,
+                    .score = eval,
+                    .mate = mate_in_moves(eval),
+                    .nodes = nodes,
+                    .nps = time_us > 0 ? (size_t) ((uint64_t) nodes * 1000000 / time_us) : 0,
+                    .time_ms = time_us / 1000,
+                    .hashfull = tt_hashfull(engine->tt),
+                    .move = move_data_create(best_moves.data[0]),
+                    .pv = thread->pv[0],
+                    .pv_length = thread->pv_length[0],
+                };
+                engine->on_score(&info);
+            }
+        }
+        if (should_stop(thread)) {
+            break;
+        }
+        thread->completed_depth = depth;
+
+        if (is_main) {
+            time_manager_update(&engine->time_manager, thread->best_moves.data[0] != previous_best_move);
+            previous_best_move = thread->best_moves.data[0];
+            if (limits_reached(thread, true)) {
+                break;
+            }
+        }
+    }
+    dai32_free(&best_moves);
+}
+
+void search_thread_main(void *arg) {
+    iterative_deepening((SearchThread *) arg);
+}
+
+void age_history(int32_t *table, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        table[i] /= 2;
+    }
+}
+
+void search_thread_prepare(SearchThread *thread, Board *board, DAi32 *root_moves) {
+    board_copy(thread->board, board);
+    thread->root_moves.size = 0;
+    for (size_t i = 0; i < root_moves->size; ++i) {
+        dai32_push(&thread->root_moves, root_moves->data[i]);
+    }
+    thread->best_moves.size = 0;
+    thread->best_pv_length = 0;
+    thread->follow_pv = false;
+    thread->path_extensions = 0;
+    memset(thread->excluded_moves, 0, sizeof(thread->excluded_moves));
+    thread->best_eval = NEG_INF;
+    thread->completed_depth = 0;
+    atomic_store(&thread->nodes, 0);
+    memset(&thread->stats, 0, sizeof(thread->stats));
+    thread->stopped = atomic_load(&thread->engine->stop);
+
+    TTData tt_data = {0};
+    bool tt_hit = tt_probe(thread->engine->tt, board_key(board), &tt_data);
+    sort_moves(thread, &thread->root_moves, 0, tt_hit ? (uint16_t) tt_data.move : 0);
+
+    // Killers are position specific, histories are only aged so they still help ordering.
+    // Countermoves are kept as they are.
+    memset(thread->killers, 0, sizeof(thread->killers));
+    age_history(&thread->history[0][0][0], sizeof(thread->history) / sizeof(int32_t));
+    age_history(&thread->capture_history[0][0][0][0], sizeof(thread->capture_history) / sizeof(int32_t));
+    age_history(&thread->continuation_history[0][0][0][0][0][0][0], sizeof(thread->continuation_history) / sizeof(int32_t));
+}
+
+size_t engine_nodes(Engine *engine) {
+    size_t nodes = 0;
+    for (size_t i = 0; i < engine->n_threads; ++i) {
+        nodes += atomic_load_explicit(&engine->threads[i].nodes, memory_order_relaxed);
+    }
+    return nodes;
+}
+
+// Sums the counters of all threads, only valid once the helpers have been joined.
+void collect_stats(Engine *engine) {
+    SearchStats *stats = &engine->stats;
+    memset(stats, 0, sizeof(*stats));
+    stats->nodes = engine_nodes(engine);
+    for (size_t i = 0; i < engine->n_threads; ++i) {
+        SearchStats *thread_stats = &engine->threads[i].stats;
+        stats->qnodes += thread_stats->qnodes;
+        stats->tt_hits += thread_stats->tt_hits;
+        stats->beta_cutoffs += thread_stats->beta_cutoffs;
+        stats->first_move_cutoffs += thread_stats->first_move_cutoffs;
+    }
+    stats->seldepth = engine->threads[0].stats.seldepth;
+}
+
+void engine_stop(Engine *engine) {
+    atomic_store(&engine->stop, true);
+}
+
+// The opponent played the expected move: the ponder search carries on as a normal search.
+void engine_ponderhit(Engine *engine) {
+    atomic_store(&engine->pondering, false);
+}
+
+// Without a PV the expected reply to best_move is the move stored in the transposition
+// table for the position after it.
+Move tt_ponder_move(Engine *engine, Board *board, Move best_move) {
+    Move ponder_move = (Move) {0};
+    apply_move(board, best_move);
+    TTData tt_data = {0};
+    if (tt_probe(engine->tt, board_key(board), &tt_data) && tt_data.move != 0) {
+        DAi32 moves = {0};
+        generate_moves(board, &moves);
+        for (size_t i = 0; i < moves.size; ++i) {
+            Move move = move_data_create(moves.data[i]);
+            if (tt_move_matches((uint16_t) tt_data.move, move)) {
+                ponder_move = move;
+                break;
+            }
+        }
+        dai32_free(&moves);
+    }
+    undo_last_move(board);
+    return ponder_move;
+}
+
+Move engine_best_move(Engine *engine, Board *board, SearchLimits limits) {
 	engine->board = board;
     if (engine->state != ENGINE_READY) {
         return (Move) {0};
     }
     engine->state = ENGINE_BUSY;
+    engine->limits = limits;
 	engine->moves->size = 0;
     generate_moves(engine->board, engine->moves);
-    //sort_moves(engine->moves);
 
-    DAi32 *best_moves = dai32_create();
-    int64_t best_eval = NEG_INF;
-    
-    int64_t alpha = NEG_INF;
-	int64_t beta = POS_INF;
-    
-    size_t depth = 5;
-    
-    for (size_t i = 0; i < engine->moves->size; ++i) {
-        Move move = move_data_create(engine->moves->data[i]);
-        apply_move(engine->board, move);
-        
-        int64_t eval = -alphabeta(engine, depth - 1, -beta, -alpha, false);
-        
-		if (eval > best_eval) {
-			best_moves->size = 0;
-			best_eval = eval;
-			dai32_push(best_moves, move.data);
-		} else if (eval == best_eval) {
-			dai32_push(best_moves, move.data);
-		}
-        
-        undo_last_move(engine->board);
+    // The stop flag is not cleared here: a stop sent right after go must still stop this search.
+    engine->start_time = time_now();
+    if (limits.move_time > 0) {
+        time_manager_init_move_time(&engine->time_manager, engine->start_time, limits.move_time);
+    } else if (limits.clock) {
+        Color us = board->to_move;
+        time_manager_init(&engine->time_manager, engine->start_time, limits.time[us], limits.inc[us], limits.moves_to_go);
+    } else {
+        time_manager_disable(&engine->time_manager);
     }
-    
-    Move best_move = (Move) {0};
-    if (best_moves->size > 0) {
-        size_t random_move_idx = rand_lim(best_moves->size);
-        best_move = move_data_create(best_moves->data[random_move_idx]);
+    tt_new_search(engine->tt);
+    for (size_t i = 0; i < engine->n_threads; ++i) {
+        search_thread_prepare(engine->threads + i, board, engine->moves);
     }
+
+    // Lazy SMP: helpers search the same position on their own boards and only communicate
+    // through the transposition table. The main thread's result is the one played.
+    size_t n_helpers = 0;
+    for (size_t i = 1; i < engine->n_threads; ++i) {
+        if (!thread_create(&engine->threads[i].handle, search_thread_main, engine->threads + i)) {
+            break;
+        }
+        ++n_helpers;
+    }
+    SearchThread *main_thread = engine->threads;
+    iterative_deepening(main_thread);
+    // An infinite or ponder search only reports its move once it is told to stop
+    // (or, when pondering, until ponderhit turns it into a normal search).
+    while ((limits.infinite || atomic_load(&engine->pondering)) && !atomic_load(&engine->stop)) {
+        sleep_ms(STOP_WAIT_MS);
+    }
+    atomic_store(&engine->stop, true);
+    for (size_t i = 1; i <= n_helpers; ++i) {
+        thread_join(engine->threads[i].handle);
+    }
+    atomic_store(&engine->stop, false);
+    atomic_store(&engine->pondering, false);
+    collect_stats(engine);
     
-    for (size_t i = 0; i < best_moves->size; ++i) {
-        Move move = move_data_create(best_moves->data[i]);
-        print_move(move);
+    // Stopped before the first iteration completed, any legal move is better than none.
+    DAi32 *best_moves = &main_thread->best_moves;
+    if (best_moves->size == 0 && main_thread->root_moves.size > 0) {
+        dai32_push(best_moves, main_thread->root_moves.data[0]);
     }
-
-    if (engine->on_score != NULL) {
-        engine->on_score(best_move, depth, best_eval);
+    Move best_move = (Move) {0};
+    engine->ponder_move = (Move) {0};
+    if (best_moves->size > 0) {
+        size_t best_move_idx = engine->random_tie_break ? rand_lim(best_moves->size) : 0;
+        best_move = move_data_create(best_moves->data[best_move_idx]);
+        // The PV belongs to the first of the tied moves, the table may know a reply to the others.
+        if (main_thread->best_pv_length > 1 && main_thread->best_pv[0] == best_move.data) {
+            engine->ponder_move = move_data_create(main_thread->best_pv[1]);
+        } else {
+            engine->ponder_move = tt_ponder_move(engine, main_thread->board, best_move);
+        }
     }
     
-	dai32_free(best_moves);
     engine->state = ENGINE_READY;
     return best_move;
 }
@@ -247,7 +1196,7 @@ void test_move_sequence(void) {
     Engine *engine = engine_create(NULL);
     engine_start(engine);
     time_t start = time_now();
-    Move move = engine_best_move(engine, board);
+    Move move = engine_best_move(engine, board, (SearchLimits) {0});
     time_t end = time_now();
     printf("%f ms\n", (end - start) / 1000.0);
     print_move(move);
@@ -255,6 +1204,192 @@ void test_move_sequence(void) {
     (void) start;
 }
 
+void test_multi_threaded_search(void) {
+    const char *fen = "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3";
+    Board *board = board_create();
+    (void) fen_to_board(fen, board);
+
+    Engine *engine = engine_create(NULL);
+    engine_set_threads(engine, 4);
+    // Resizing reuses the boards of the threads that already exist.
+    Board *main_board = engine->threads[0].board;
+    engine_set_threads(engine, 2);
+    engine_set_threads(engine, 4);
+    assert(engine->threads[0].board == main_board);
+    assert(engine->threads[3].board == engine->thread_boards[3]);
+    engine_start(engine);
+    Move move = engine_best_move(engine, board, (SearchLimits) {0});
+    assert(!is_move_null(move));
+    assert(engine->state == ENGINE_READY);
+
+    // The board given to the engine must be left untouched by the threads.
+    DA *da = da_create();
+    assert(strcmp(board_to_fen(board, da), fen) == 0);
+    da_free(da);
+}
+
+static SearchInfo test_lines[MAX_MULTI_PV];
+static uint32_t test_pv[MAX_PLY];
+
+static void test_record_line(const SearchInfo *info) {
+    test_lines[info->multi_pv - 1] = *info;
+    if (info->multi_pv == 1) {
+        memcpy(test_pv, info->pv, info->pv_length * sizeof(info->pv[0]));
+    }
+}
+
+void test_multi_pv(void) {
+    const char *fen = "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3";
+    Board *board = board_create();
+    (void) fen_to_board(fen, board);
+
+    Engine *engine = engine_create(test_record_line);
+    engine_set_multi_pv(engine, 3);
+    engine_start(engine);
+    memset(test_lines, 0, sizeof(test_lines));
+    Move move = engine_best_move(engine, board, (SearchLimits) { .depth = 4 });
+    assert(!is_move_null(move));
+
+    // Every line is reported at the final depth with a distinct move and a score
+    // no better than the line before it.
+    for (size_t i = 0; i < 3; ++i) {
+        assert(test_lines[i].depth == 4);
+        assert(!is_move_null(test_lines[i].move));
+        if (i > 0) {
+            assert(test_lines[i].move.data != test_lines[i - 1].move.data);
+            assert(test_lines[i].score <= test_lines[0].score);
+        }
+    }
+    assert(test_lines[0].move.data != test_lines[2].move.data);
+}
+
+void test_principal_variation(void) {
+    const char *fen = "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3";
+    Board *board = board_create();
+    (void) fen_to_board(fen, board);
+
+    Engine *engine = engine_create(test_record_line);
+    engine_start(engine);
+    memset(test_lines, 0, sizeof(test_lines));
+    Move move = engine_best_move(engine, board, (SearchLimits) { .depth = 5 });
+    assert(!is_move_null(move));
+
+    // The reported line is at least as long as the nominal depth and every move in it is legal.
+    size_t pv_length = test_lines[0].pv_length;
+    assert(pv_length >= 5);
+    assert(test_pv[0] == test_lines[0].move.data);
+    for (size_t i = 0; i < pv_length; ++i) {
+        DAi32 moves = {0};
+        generate_moves(board, &moves);
+        bool legal = false;
+        for (size_t j = 0; j < moves.size; ++j) {
+            legal = legal || moves.data[j] == test_pv[i];
+        }
+        assert(legal);
+        dai32_free(&moves);
+        apply_move(board, move_data_create(test_pv[i]));
+    }
+    if (move.data == test_pv[0]) {
+        assert(engine->ponder_move.data == test_pv[1]);
+    }
+}
+
+void test_mate_scores(void) {
+    // Back rank mate in one, and mate in two starting with a knight check.
+    const char *fens[] = {
+        "6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1",
+        "r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq - 1 1",
+    };
+    const char *best_moves[] = {"a1a8", "d5f6"};
+    for (size_t i = 0; i < 2; ++i) {
+        Board *board = board_create();
+        (void) fen_to_board(fens[i], board);
+
+        Engine *engine = engine_create(test_record_line);
+        engine_start(engine);
+        memset(test_lines, 0, sizeof(test_lines));
+        Move move = engine_best_move(engine, board, (SearchLimits) { .depth = 4 });
+        assert(move.from == COORD_TO_IDX(best_moves[i]));
+        assert(move.to == COORD_TO_IDX(best_moves[i] + 2));
+        assert(test_lines[0].mate == (int64_t) i + 1);
+    }
+
+    assert(score_from_tt(score_to_tt(MATE_SCORE - 5, 3), 3) == MATE_SCORE - 5);
+    assert(score_from_tt(score_to_tt(-MATE_SCORE + 4, 2), 1) == -MATE_SCORE + 3);
+    assert(mate_in_moves(MATE_SCORE - 3) == 2);
+    assert(mate_in_moves(-MATE_SCORE + 2) == -1);
+    assert(mate_in_moves(0) == 0);
+}
+
+void test_deterministic_search(void) {
+    const char *fen = "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3";
+    const size_t node_limit = 20000;
+    Move moves[2];
+    size_t nodes[2];
+    for (size_t i = 0; i < 2; ++i) {
+        Board *board = board_create();
+        (void) fen_to_board(fen, board);
+        Engine *engine = engine_create(NULL);
+        engine->random_tie_break = false;
+        engine_start(engine);
+        moves[i] = engine_best_move(engine, board, (SearchLimits) { .nodes = node_limit });
+        nodes[i] = engine->stats.nodes;
+    }
+    // A single thread stops exactly at the limit and repeats itself.
+    assert(nodes[0] == node_limit);
+    assert(nodes[0] == nodes[1]);
+    assert(moves[0].data == moves[1].data);
+}
+
+void test_move_ordering_histories(void) {
+    Engine *engine = engine_create(NULL);
+    SearchThread *thread = engine->threads;
+    Board *board = thread->board;
+    (void) fen_to_board("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", board);
+    apply_move(board, move_create(ATcoord(board, "e2"), COORD_TO_IDX("e2"), COORD_TO_IDX("e4"), NORMAL, NONE, NONE));
+    Move knight_c6 = move_create(ATcoord(board, "b8"), COORD_TO_IDX("b8"), COORD_TO_IDX("c6"), NORMAL, NONE, NONE);
+    Move knight_f6 = move_create(ATcoord(board, "g8"), COORD_TO_IDX("g8"), COORD_TO_IDX("f6"), NORMAL, NONE, NONE);
+    Move pawn_d6 = move_create(ATcoord(board, "d7"), COORD_TO_IDX("d7"), COORD_TO_IDX("d6"), NORMAL, NONE, NONE);
+
+    // d6 was ordered before the cutoff but pruned, so only c6 failed to refute.
+    uint32_t tried[] = {knight_c6.data};
+    update_cutoff_stats(thread, knight_f6, 1, 4, tried, 1);
+    assert(countermove(thread) == knight_f6.data);
+    assert(quiet_history(thread, knight_f6) > 0);
+    assert(quiet_history(thread, knight_c6) < 0);
+    assert(quiet_history(thread, pawn_d6) == 0);
+
+    // Away from the killers' ply the countermove leads the quiet moves.
+    DAi32 moves = {0};
+    generate_moves(board, &moves);
+    sort_moves(thread, &moves, 2, 0);
+    assert(moves.data[0] == knight_f6.data);
+    dai32_free(&moves);
+}
+
+void test_correction_history(void) {
+    Engine *engine = engine_create(NULL);
+    SearchThread *thread = engine->threads;
+    Board *board = thread->board;
+    (void) fen_to_board("4k3/pppp4/8/8/8/8/4PPPP/4K3 w - - 0 1", board);
+    assert(corrected_eval(thread, board, 0) == 0);
+    for (size_t i = 0; i < 100; ++i) {
+        update_correction_history(thread, board, 10, 40);
+    }
+    // Converges to the observed error, and only for this side to move.
+    int64_t eval = corrected_eval(thread, board, 0);
+    assert(eval >= 35 && eval <= 40);
+    board->to_move = BLACK;
+    assert(corrected_eval(thread, board, 0) == 0);
+}
+
 void test_engine(void) {
 	test_wrapper(test_move_sequence);
+	test_wrapper(test_multi_threaded_search);
+	test_wrapper(test_multi_pv);
+	test_wrapper(test_principal_variation);
+	test_wrapper(test_mate_scores);
+	test_wrapper(test_deterministic_search);
+	test_wrapper(test_move_ordering_histories);
+	test_wrapper(test_correction_history);
 }
@@ -0,0 +1,410 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eval.h"
+#include "board.h"
+#include "common.h"
+#include "defs.h"
+#include "tests.h"
+#include "utils.h"
+
+#define FILE_A_BB 0x0101010101010101ULL
+#define FILE_H_BB (FILE_A_BB << 7)
+
+// Pawn structure
+static const Score passed_bonus[8] = {  // By rank from the pawn's own side
+    S(0, 0), S(0, 5), S(5, 10), S(10, 20), S(20, 40), S(35, 70), S(60, 110), S(0, 0),
+};
+#define ISOLATED_PENALTY S(-5, -15)
+#define DOUBLED_PENALTY S(-10, -20)
+#define BACKWARD_PENALTY S(-8, -10)
+
+// Mobility, indexed by the number of safe squares attacked
+static const Score mobility_bonus[7][28] = {
+    [KNIGHT] = {
+        S(-31,-40), S(-26,-28), S( -6,-15), S( -2, -7), S(  2,  4), S(  6,  8), S( 11, 12), S( 14, 14),
+        S( 16, 16),
+    },
+    [BISHOP] = {
+        S(-24,-30), S(-10,-12), S(  8, -2), S( 13,  6), S( 19, 12), S( 25, 21), S( 28, 27), S( 31, 28),
+        S( 31, 33), S( 34, 36), S( 40, 39), S( 40, 43), S( 45, 44), S( 49, 48),
+    },
+    [ROOK] = {
+        S(-29,-38), S(-13, -9), S( -8, 14), S( -5, 28), S( -2, 34), S( -1, 41), S(  4, 56), S(  8, 59),
+        S( 15, 66), S( 14, 71), S( 16, 78), S( 19, 83), S( 23, 83), S( 24, 85), S( 29, 86),
+    },
+    [QUEEN] = {
+        S(-20,-18), S(-10, -8), S(  2,  4), S(  2,  9), S(  7, 17), S( 11, 27), S( 14, 30), S( 20, 36),
+        S( 22, 40), S( 24, 46), S( 28, 47), S( 30, 52), S( 30, 56), S( 33, 60), S( 34, 62), S( 35, 63),
+        S( 36, 66), S( 36, 68), S( 40, 70), S( 44, 72), S( 44, 74), S( 50, 83), S( 51, 85), S( 51, 88),
+        S( 53, 92), S( 55, 96), S( 56,103), S( 58,106),
+    },
+};
+
+// King safety
+static const int64_t king_attack_weights[7] = {[KNIGHT] = 2, [BISHOP] = 2, [ROOK] = 3, [QUEEN] = 5};
+#define KING_DANGER_MIN_ATTACKERS 2  // A lone attacker is not scored
+#define KING_DANGER_DIVISOR 4
+#define KING_DANGER_MAX 500LL
+
+// Lazy evaluation
+#define LAZY_EVAL_MARGIN 400LL  // Beyond what pawn structure, mobility and king danger usually add
+
+EvalCache *eval_cache_create(size_t size_mb) {
+    EvalCache *cache = (EvalCache *) arena_allocate(&arena, sizeof(EvalCache));
+    cache->entries = NULL;
+    cache->size = 0;
+    eval_cache_resize(cache, size_mb);
+    return cache;
+}
+
+// Falls back like tt_resize when there is not enough memory.
+bool eval_cache_resize(EvalCache *cache, size_t size_mb) {
+    size_t size = 1;
+    while (2 * size * sizeof(EvalCacheEntry) <= size_mb * 1024 * 1024) {
+        size *= 2;
+    }
+    aligned_free(cache->entries);
+    cache->entries = (EvalCacheEntry *) aligned_malloc(CACHE_LINE_SIZE, size * sizeof(EvalCacheEntry));
+    bool resized = cache->entries != NULL;
+    size_t fallback = cache->size > 0 && cache->size < size ? cache->size : size / 2;
+    while (cache->entries == NULL && fallback > 0) {
+        size = fallback;
+        cache->entries = (EvalCacheEntry *) aligned_malloc(CACHE_LINE_SIZE, size * sizeof(EvalCacheEntry));
+        fallback /= 2;
+    }
+    cache->size = size;
+    eval_cache_clear(cache);
+    return resized;
+}
+
+size_t eval_cache_size_mb(EvalCache *cache) {
+    return cache->size * sizeof(EvalCacheEntry) / (1024 * 1024);
+}
+
+void eval_cache_clear(EvalCache *cache) {
+    memset(cache->entries, 0, cache->size * sizeof(EvalCacheEntry));
+}
+
+bool eval_cache_probe(EvalCache *cache, uint64_t key, int64_t *eval) {
+    EvalCacheEntry *entry = cache->entries + (key & (cache->size - 1));
+    // Same lockless read as tt_probe.
+    uint64_t entry_eval = entry->eval;
+    uint64_t entry_key = entry->key;
+    if ((entry_key ^ entry_eval) != key) {
+        return false;
+    }
+    *eval = (int64_t) entry_eval;
+    return true;
+}
+
+void eval_cache_store(EvalCache *cache, uint64_t key, int64_t eval) {
+    EvalCacheEntry *entry = cache->entries + (key & (cache->size - 1));
+    entry->key = key ^ (uint64_t) eval;
+    entry->eval = (uint64_t) eval;
+}
+
+uint64_t north_fill(uint64_t bb) {
+    bb |= bb << 8;
+    bb |= bb << 16;
+    bb |= bb << 32;
+    return bb;
+}
+
+uint64_t south_fill(uint64_t bb) {
+    bb |= bb >> 8;
+    bb |= bb >> 16;
+    bb |= bb >> 32;
+    return bb;
+}
+
+uint64_t east_one(uint64_t bb) {
+    return (bb << 1) & ~FILE_A_BB;
+}
+
+uint64_t west_one(uint64_t bb) {
+    return (bb >> 1) & ~FILE_H_BB;
+}
+
+// Squares ahead of the pawns on their own files, from color's point of view.
+uint64_t front_spans(uint64_t pawns, Color color) {
+    return color == WHITE ? north_fill(pawns) << 8 : south_fill(pawns) >> 8;
+}
+
+uint64_t pawn_attacks_bb(uint64_t pawns, Color color) {
+    uint64_t pushed = color == WHITE ? pawns << 8 : pawns >> 8;
+    return east_one(pushed) | west_one(pushed);
+}
+
+Score evaluate_pawns_of(uint64_t *passed, uint64_t own, uint64_t their, Color color) {
+    Color them = !color;
+    uint64_t their_spans = front_spans(their, them);
+    uint64_t own_files = north_fill(own) | south_fill(own);
+    uint64_t stops = color == WHITE ? own << 8 : own >> 8;
+    // Squares own pawns attack now or after advancing, where a pawn can still be defended.
+    uint64_t own_attack_spans = color == WHITE ? north_fill(pawn_attacks_bb(own, color))
+                                               : south_fill(pawn_attacks_bb(own, color));
+
+    *passed = own & ~(their_spans | east_one(their_spans) | west_one(their_spans));
+    uint64_t isolated = own & ~(east_one(own_files) | west_one(own_files));
+    uint64_t doubled = own & front_spans(own, them);  // Pawns with another one in front
+    uint64_t backward_stops = stops & pawn_attacks_bb(their, them) & ~own_attack_spans;
+    uint64_t backward = (color == WHITE ? backward_stops >> 8 : backward_stops << 8) & ~isolated;
+
+    Score score = ISOLATED_PENALTY * (Score) count_bits(isolated)
+        + DOUBLED_PENALTY * (Score) count_bits(doubled)
+        + BACKWARD_PENALTY * (Score) count_bits(backward);
+    for (uint64_t bb = *passed; bb; bb &= bb - 1) {
+        size_t idx = next_piece_idx(bb);
+        size_t rank = color == WHITE ? IDX_Y(idx) : 7 - IDX_Y(idx);
+        score += passed_bonus[rank];
+    }
+    return score;
+}
+
+PawnEntry evaluate_pawns(const Board *board) {
+    PawnEntry entry = {0};
+    entry.key = board->pawn_hash;
+    uint64_t white = board->bb[PAWN][WHITE];
+    uint64_t black = board->bb[PAWN][BLACK];
+    entry.score = evaluate_pawns_of(&entry.passed[WHITE], white, black, WHITE)
+        - evaluate_pawns_of(&entry.passed[BLACK], black, white, BLACK);
+    return entry;
+}
+
+// Pawn entry of the position, from the table when it is there. A zeroed entry is correct for
+// key 0, a position without pawns, so an empty table needs no marker.
+PawnEntry probe_pawns(const Board *board, PawnTable *table) {
+    if (table == NULL) {
+        return evaluate_pawns(board);
+    }
+    PawnEntry *entry = table->entries + (board->pawn_hash & (PAWN_TABLE_SIZE - 1));
+    if (entry->key != board->pawn_hash) {
+        *entry = evaluate_pawns(board);
+    }
+    return *entry;
+}
+
+// Mobility of color's knights, bishops, rooks and queens over the squares not taken by own
+// pawns or king nor attacked by enemy pawns, plus the danger they pose to the enemy king:
+// attacker weights summed over the hits on its zone, growing quadratically. Their attacks
+// are added to maps, whose pawn attacks must already be set.
+Score evaluate_pieces(Board *board, Color color, uint64_t occupied, AttackMaps *maps) {
+    Color them = !color;
+    uint64_t mobility_area = ~(board->bb[PAWN][color] | board->bb[KING][color] | maps->by_type[PAWN][them]);
+    uint64_t king_zone = board->king_bb[them] | king_attacks[get_king_idx(board, them)];
+    Score score = 0;
+    size_t attackers = 0;
+    int64_t danger = 0;
+    for (PieceType type = KNIGHT; type <= QUEEN; ++type) {
+        for (uint64_t bb = board->bb[type][color]; bb; bb &= bb - 1) {
+            uint64_t attacks = piece_attacks(type, next_piece_idx(bb), occupied);
+            maps->by_type[type][color] |= attacks;
+            score += mobility_bonus[type][count_bits(attacks & mobility_area)];
+            uint64_t zone_attacks = attacks & king_zone;
+            if (zone_attacks) {
+                ++attackers;
+                danger += king_attack_weights[type] * (int64_t) count_bits(zone_attacks);
+            }
+        }
+    }
+    if (attackers >= KING_DANGER_MIN_ATTACKERS) {
+        int64_t mg_danger = danger * danger / KING_DANGER_DIVISOR;
+        mg_danger = min(mg_danger, KING_DANGER_MAX);
+        score += S(mg_danger, danger);
+    }
+    return score;
+}
+
+// Blend of the midgame and endgame halves of score by game phase, from the side to move's
+// point of view, so the score moves smoothly into the endgame.
+int64_t taper(const Board *board, Score score) {
+    int64_t phase = board->phase;
+    phase = min(phase, (int64_t) PHASE_MAX);
+    int64_t mg = MG_VALUE(score);
+    int64_t eg = EG_VALUE(score);
+    int64_t eval = (mg * phase + eg * (PHASE_MAX - phase)) / PHASE_MAX;
+    return board->to_move == WHITE ? eval : -eval;
+}
+
+// Static evaluation from the side to move's point of view, the position is assumed to
+// have legal moves. cache and pawn_table may be NULL. maps, if not NULL, receives the
+// attacks of both sides unless the eval comes from the cache or is lazy.
+// Lazy evaluation: when material and piece-square tables alone are further than
+// LAZY_EVAL_MARGIN outside (alpha, beta), that score is returned instead. Such a score
+// depends on the window, so only full evals are cached.
+int64_t evaluate_board(Board *board, EvalCache *cache, PawnTable *pawn_table, AttackMaps *maps, int64_t alpha, int64_t beta) {
+	size_t half_move_clock = n_moves_since_last_pawn_or_capture_move(board);
+	if (half_move_clock >= 50) {
+		return 0LL;
+	}
+    uint64_t key = board_key(board);
+    int64_t cached_eval;
+    if (cache != NULL && eval_cache_probe(cache, key, &cached_eval)) {
+        return cached_eval;
+    }
+    int64_t lazy_eval = taper(board, board->psqt_score);
+    if (lazy_eval + LAZY_EVAL_MARGIN <= alpha || lazy_eval - LAZY_EVAL_MARGIN >= beta) {
+        return lazy_eval;
+    }
+    Score score = board->psqt_score + probe_pawns(board, pawn_table).score;
+
+    AttackMaps local_maps;
+    if (maps == NULL) {
+        maps = &local_maps;
+    }
+    memset(maps, 0, sizeof(AttackMaps));
+    for (size_t color = 0; color < 2; ++color) {
+        maps->by_type[PAWN][color] = pawn_attacks_bb(board->bb[PAWN][color], (Color) color);
+        maps->by_type[KING][color] = king_attacks[get_king_idx(board, (Color) color)];
+    }
+    uint64_t occupied = occupied_bb(board);
+    score += evaluate_pieces(board, WHITE, occupied, maps) - evaluate_pieces(board, BLACK, occupied, maps);
+    for (size_t color = 0; color < 2; ++color) {
+        for (size_t type = PAWN; type <= KING; ++type) {
+            maps->by_color[color] |= maps->by_type[type][color];
+        }
+    }
+    maps->key = key;
+
+    int64_t eval = taper(board, score);
+    if (cache != NULL) {
+        eval_cache_store(cache, key, eval);
+    }
+    return eval;
+}
+
+// ====================================
+
+void test_eval_cache(void) {
+    EvalCache *cache = eval_cache_create(1);
+    assert(cache->size == 1024 * 1024 / sizeof(EvalCacheEntry));
+    uint64_t key = 0x0123456789ABCDEFULL;
+    int64_t eval = 0;
+    assert(!eval_cache_probe(cache, key, &eval));
+    eval_cache_store(cache, key, -321);
+    assert(eval_cache_probe(cache, key, &eval) && eval == -321);
+    assert(!eval_cache_probe(cache, key ^ cache->size, &eval));
+
+    // Flipping a bit of the stored eval breaks the key xor eval check.
+    cache->entries[key & (cache->size - 1)].eval ^= 1;
+    assert(!eval_cache_probe(cache, key, &eval));
+
+    // Only full evals are stored, a lazy one depends on the window.
+    eval_cache_clear(cache);
+    Board *board = board_create();
+    (void) fen_to_board("r3k3/ppp2ppp/2n5/8/8/2N5/PPP2PPP/R3K2R w - - 0 1", board);
+    (void) evaluate_board(board, cache, NULL, NULL, -100, -99);
+    assert(!eval_cache_probe(cache, board_key(board), &eval));
+    int64_t full = evaluate_board(board, cache, NULL, NULL, INT64_MIN, INT64_MAX);
+    assert(eval_cache_probe(cache, board_key(board), &eval) && eval == full);
+    assert(evaluate_board(board, cache, NULL, NULL, -100, -99) == full);
+
+    // An allocation that cannot succeed falls back to the previous size.
+    assert(!eval_cache_resize(cache, (size_t) 1 << 40));
+    assert(eval_cache_size_mb(cache) == 1);
+    eval_cache_store(cache, key, 5);
+    assert(eval_cache_probe(cache, key, &eval) && eval == 5);
+    aligned_free(cache->entries);
+}
+
+void test_pawn_structure(void) {
+    Board *board = board_create();
+    // White: a2 isolated and passed, c2 and c3 doubled and blocked by c5, e6 passed.
+    (void) fen_to_board("4k3/8/4P3/2pp4/8/2P5/P1P5/4K3 w - - 0 1", board);
+    PawnEntry entry = evaluate_pawns(board);
+    assert(entry.key == board->pawn_hash);
+    assert(entry.passed[WHITE] == (1ULL << COORD_TO_IDX("e6")) + (1ULL << COORD_TO_IDX("a2")));
+    assert(entry.passed[BLACK] == 0);
+
+    // Mirroring the position swaps the passers and negates the score.
+    Board *mirrored = board_create();
+    (void) fen_to_board("4k3/p1p5/2p5/8/2PP4/4p3/8/4K3 b - - 0 1", mirrored);
+    PawnEntry mirrored_entry = evaluate_pawns(mirrored);
+    assert(mirrored_entry.score == -entry.score);
+    assert(mirrored_entry.passed[BLACK] == ((1ULL << COORD_TO_IDX("e3")) + (1ULL << COORD_TO_IDX("a7"))));
+}
+
+void test_pawn_table(void) {
+    PawnTable *table = (PawnTable *) malloc(sizeof(PawnTable));
+    memset(table, 0, sizeof(PawnTable));
+    Board *board = board_create();
+    place_initial_pieces(board);
+    PawnEntry computed = evaluate_pawns(board);
+    PawnEntry stored = probe_pawns(board, table);
+    assert(stored.score == computed.score);
+    assert(table->entries[board->pawn_hash & (PAWN_TABLE_SIZE - 1)].key == board->pawn_hash);
+    assert(probe_pawns(board, table).score == computed.score);
+    assert(evaluate_board(board, NULL, table, NULL, INT64_MIN, INT64_MAX) == evaluate_board(board, NULL, NULL, NULL, INT64_MIN, INT64_MAX));
+    free(table);
+}
+
+void test_mobility(void) {
+    Board *board = board_create();
+    (void) fen_to_board("4k3/8/8/8/3N4/8/8/N3K3 w - - 0 1", board);
+    AttackMaps maps = {0};
+    (void) evaluate_board(board, NULL, NULL, &maps, INT64_MIN, INT64_MAX);
+    assert(maps.key == board_key(board));
+    assert(maps.by_type[KNIGHT][WHITE] == (knight_attacks[COORD_TO_IDX("a1")] | knight_attacks[COORD_TO_IDX("d4")]));
+    assert(maps.by_color[BLACK] == king_attacks[COORD_TO_IDX("e8")]);
+
+    // A centralised knight is more mobile than one in the corner.
+    Board *centre = board_create();
+    (void) fen_to_board("4k3/8/8/8/3N4/8/8/4K3 w - - 0 1", centre);
+    Board *corner = board_create();
+    (void) fen_to_board("4k3/8/8/8/8/8/8/N3K3 w - - 0 1", corner);
+    AttackMaps centre_maps = {0};
+    AttackMaps corner_maps = {0};
+    Score centre_score = evaluate_pieces(centre, WHITE, occupied_bb(centre), &centre_maps);
+    Score corner_score = evaluate_pieces(corner, WHITE, occupied_bb(corner), &corner_maps);
+    assert(MG_VALUE(centre_score) > MG_VALUE(corner_score));
+    assert(EG_VALUE(centre_score) > EG_VALUE(corner_score));
+}
+
+void test_king_danger(void) {
+    // The same queen and knight, once both hitting the king's zone and once far away.
+    Board *attacking = board_create();
+    (void) fen_to_board("6k1/5ppp/8/6N1/8/8/1Q6/4K3 w - - 0 1", attacking);
+    Board *quiet = board_create();
+    (void) fen_to_board("6k1/5ppp/8/8/8/8/8/NQ2K3 w - - 0 1", quiet);
+    AttackMaps maps = {0};
+    Score attacking_score = evaluate_pieces(attacking, WHITE, occupied_bb(attacking), &maps);
+    memset(&maps, 0, sizeof(maps));
+    Score quiet_score = evaluate_pieces(quiet, WHITE, occupied_bb(quiet), &maps);
+    int64_t danger = (2 * 2 + 5 * 1);  // Knight hits f7 and h7, queen hits g7
+    assert(MG_VALUE(attacking_score) - MG_VALUE(quiet_score) > danger * danger / KING_DANGER_DIVISOR / 2);
+}
+
+void test_lazy_eval(void) {
+    // White is a rook up, which decides any window far enough below.
+    Board *board = board_create();
+    (void) fen_to_board("r3k3/ppp2ppp/2n5/8/8/2N5/PPP2PPP/R3K2R w - - 0 1", board);
+    int64_t full = evaluate_board(board, NULL, NULL, NULL, INT64_MIN, INT64_MAX);
+    int64_t lazy = taper(board, board->psqt_score);
+    assert(full != lazy);
+    AttackMaps maps = {0};
+    assert(evaluate_board(board, NULL, NULL, &maps, -100, -99) == lazy);
+    assert(maps.key == 0);
+    assert(evaluate_board(board, NULL, NULL, &maps, lazy - 1, lazy + 1) == full);
+    assert(maps.key == board_key(board));
+}
+
+void test_eval_symmetry(void) {
+    // The same position with colors swapped scores the same for the side to move.
+    Board *board = board_create();
+    (void) fen_to_board("r1bqk2r/pp3ppp/2n1pn2/3p4/1bPP4/2N2N2/PP3PPP/R1BQKB1R w KQkq - 0 7", board);
+    Board *mirrored = board_create();
+    (void) fen_to_board("r1bqkb1r/pp3ppp/2n2n2/1Bpp4/3P4/2N1PN2/PP3PPP/R1BQK2R b KQkq - 0 7", mirrored);
+    assert(evaluate_board(board, NULL, NULL, NULL, INT64_MIN, INT64_MAX) == evaluate_board(mirrored, NULL, NULL, NULL, INT64_MIN, INT64_MAX));
+}
+
+void test_eval(void) {
+    test_wrapper(test_eval_cache);
+    test_wrapper(test_pawn_structure);
+    test_wrapper(test_pawn_table);
+    test_wrapper(test_mobility);
+    test_wrapper(test_king_danger);
+    test_wrapper(test_lazy_eval);
+    test_wrapper(test_eval_symmetry);
+}
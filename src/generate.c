@@ -272,8 +272,7 @@ bool validate_and_push_move(Board *board, DAi32 *moves, Move move) {
     return is_valid;
 }
 
-bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found) {
-    (void) return_on_found;
+bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only) {
     Piece piece = board->pieces[idx];
     assert(piece.type == PAWN);
 
@@ -295,18 +294,24 @@ bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
         if ((y == 6 && piece.color == WHITE) || (y == 1 && piece.color == BLACK)) {
             for (size_t i = 0; i < sizeof(possible_promotions) / sizeof(possible_promotions[0]); ++i) {
                 Move promotion_move = move_create(piece, idx, one_step, PROMOTION, possible_promotions[i], NONE);
-                validate_and_push_move(board, moves, promotion_move);
+                if (validate_and_push_move(board, moves, promotion_move) && return_on_found) {
+                    return true;
+                }
             }
-        } else {
+        } else if (!captures_only) {
             // One step move
             Move one_step_move = move_create(piece, idx, one_step, NORMAL, NONE, NONE);
-            validate_and_push_move(board, moves, one_step_move);
+            if (validate_and_push_move(board, moves, one_step_move) && return_on_found) {
+                return true;
+            }
             size_t two_steps = YX_TO_IDX(y + 2 * dir, x);
             // Two steps move
             if ((y == 1 && piece.color == WHITE) || (y == 6 && piece.color == BLACK)) {
                 if (is_piece_null(board_safe_at(board, two_steps))) {
                     Move two_steps_move = move_create(piece, idx, two_steps, NORMAL, NONE, NONE);      
-                    validate_and_push_move(board, moves, two_steps_move);
+                    if (validate_and_push_move(board, moves, two_steps_move) && return_on_found) {
+                        return true;
+                    }
                 }
             }
         }
@@ -327,11 +332,15 @@ bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
             if ((dest_y == 7 && piece.color == WHITE) || (dest_y == 0 && piece.color == BLACK)) {
                 for (size_t j = 0; j < sizeof(possible_promotions) / sizeof(possible_promotions[0]); ++j) {
                     Move promotion_move = move_create(piece, idx, dest, CAPTURE | PROMOTION, possible_promotions[j], board->pieces[dest].type);
-                    validate_and_push_move(board, moves, promotion_move);
+                    if (validate_and_push_move(board, moves, promotion_move) && return_on_found) {
+                        return true;
+                    }
                 }
             } else {
                 Move move = move_create(piece, idx, dest, CAPTURE, NONE, board->pieces[dest].type);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             }
         }
     }
@@ -349,7 +358,9 @@ bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
                 if (last_move_from_y == 2 * dir + last_move_to_y) {
                     size_t dest = YX_TO_IDX(last_move_to_y + dir, last_move_to_x);
                     Move move = move_create(piece, idx, dest, CAPTURE | EN_PASSANT, NONE, PAWN);
-                    validate_and_push_move(board, moves, move);
+                    if (validate_and_push_move(board, moves, move) && return_on_found) {
+                        return true;
+                    }
                 }
             }
         }
@@ -357,8 +368,7 @@ bool generate_pawn_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
     return false;
 }
 
-bool generate_bishop_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found) {
-    (void) return_on_found;
+bool generate_bishop_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only) {
     Piece piece = board->pieces[idx];
     assert(piece.type == BISHOP);
 
@@ -380,12 +390,19 @@ bool generate_bishop_moves(Board *board, size_t idx, DAi32 *moves, bool return_o
                 break;
             }
             if (is_piece_null(board->pieces[dest])) {
+                if (captures_only) {
+                    continue;
+                }
                 Move move = move_create(piece, idx, dest, NORMAL, NONE, NONE);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             } else {
                 if (board->pieces[dest].color != piece.color && board->pieces[dest].type != KING) {
                     Move move = move_create(piece, idx, dest, CAPTURE, NONE, board->pieces[dest].type);
-                    validate_and_push_move(board, moves, move);
+                    if (validate_and_push_move(board, moves, move) && return_on_found) {
+                        return true;
+                    }
                 }
                 break;
             }
@@ -394,8 +411,7 @@ bool generate_bishop_moves(Board *board, size_t idx, DAi32 *moves, bool return_o
     return false;
 }
 
-bool generate_rook_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found) {
-    (void) return_on_found;
+bool generate_rook_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only) {
     Piece piece = board->pieces[idx];
     assert(piece.type == ROOK);
 
@@ -417,12 +433,19 @@ bool generate_rook_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
                 break;
             }
             if (is_piece_null(board->pieces[dest])) {
+                if (captures_only) {
+                    continue;
+                }
                 Move move = move_create(piece, idx, dest, NORMAL, NONE, NONE);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             } else {
                 if (board->pieces[dest].color != piece.color && board->pieces[dest].type != KING) {
                     Move move = move_create(piece, idx, dest, CAPTURE, NONE, board->pieces[dest].type);
-                    validate_and_push_move(board, moves, move);
+                    if (validate_and_push_move(board, moves, move) && return_on_found) {
+                        return true;
+                    }
                 }
                 break;
             }
@@ -431,8 +454,7 @@ bool generate_rook_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
     return false;
 }
 
-bool generate_queen_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found) {
-    (void) return_on_found;
+bool generate_queen_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only) {
     Piece piece = board->pieces[idx];
     assert(piece.type == QUEEN);
 
@@ -458,12 +480,19 @@ bool generate_queen_moves(Board *board, size_t idx, DAi32 *moves, bool return_on
                 break;
             }
             if (is_piece_null(board->pieces[dest])) {
+                if (captures_only) {
+                    continue;
+                }
                 Move move = move_create(piece, idx, dest, NORMAL, NONE, NONE);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             } else {
                 if (board->pieces[dest].color != piece.color && board->pieces[dest].type != KING) {
                     Move move = move_create(piece, idx, dest, CAPTURE, NONE, board->pieces[dest].type);
-                    validate_and_push_move(board, moves, move);
+                    if (validate_and_push_move(board, moves, move) && return_on_found) {
+                        return true;
+                    }
                 }
                 break;
             }
@@ -472,8 +501,7 @@ bool generate_queen_moves(Board *board, size_t idx, DAi32 *moves, bool return_on
     return false;
 }
 
-bool generate_knight_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found) {
-    (void) return_on_found;
+bool generate_knight_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only) {
     Piece piece = board->pieces[idx];
     assert(piece.type == KNIGHT);
 
@@ -498,20 +526,26 @@ bool generate_knight_moves(Board *board, size_t idx, DAi32 *moves, bool return_o
         }
         size_t dest = YX_TO_IDX(y + dir_y, x + dir_x);
         if (is_piece_null(board->pieces[dest])) {
+            if (captures_only) {
+                continue;
+            }
             Move move = move_create(piece, idx, dest, NORMAL, NONE, NONE);
-            validate_and_push_move(board, moves, move);
+            if (validate_and_push_move(board, moves, move) && return_on_found) {
+                return true;
+            }
         } else {
             if (board->pieces[dest].color != piece.color && board->pieces[dest].type != KING) {
                 Move move = move_create(piece, idx, dest, CAPTURE, NONE, board->pieces[dest].type);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             }
         }
     }
     return false;
 }
 
-bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found) {
-    (void) return_on_found;
+bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_found, bool captures_only) {
     Piece piece = board->pieces[idx];
     assert(piece.type == KING);
 
@@ -556,18 +590,26 @@ bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
         //     continue;
         // }
         if (is_piece_null(board->pieces[dest])) {
+            if (captures_only) {
+                continue;
+            }
             Move move = move_create(piece, idx, dest, NORMAL, NONE, NONE);
-            validate_and_push_move(board, moves, move);
+            if (validate_and_push_move(board, moves, move) && return_on_found) {
+                return true;
+            }
         } else {
             if (board->pieces[dest].color != piece.color && board->pieces[dest].type != KING) {
                 Move move = move_create(piece, idx, dest, CAPTURE, NONE, board->pieces[dest].type);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             }
         }
     }
 
     // Castle
-    bool castling_maybe_available = (board->first_king_move[piece.color] == 0)
+    bool castling_maybe_available = !captures_only
+        && (board->first_king_move[piece.color] == 0)
         && ((board->first_king_rook_move[piece.color] == 0) || (board->first_queen_rook_move[piece.color] == 0));
     if (castling_maybe_available) {
         uint8_t attacked[64] = {0};
@@ -589,7 +631,9 @@ bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
                 && is_piece_null(board->pieces[sq_2])
                 && is_piece_null(board->pieces[sq_3])) {
                 Move move = move_create(piece, idx, sq_3, CASTLE, NONE, NONE);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             }
         }
         if (board->first_queen_rook_move[piece.color] == 0) {
@@ -608,7 +652,9 @@ bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
                 && is_piece_null(board->pieces[sq_3])
                 && is_piece_null(board->pieces[sq_4])) {
                 Move move = move_create(piece, idx, sq_3, CASTLE, NONE, NONE);
-                validate_and_push_move(board, moves, move);
+                if (validate_and_push_move(board, moves, move) && return_on_found) {
+                    return true;
+                }
             }
         }
         // }
@@ -616,11 +662,11 @@ bool generate_king_moves(Board *board, size_t idx, DAi32 *moves, bool return_on_
     return false;
 }
 
-void generate_moves(Board *board, DAi32 *moves) {
-    time_t start_time = time_now();
-
+// Pushes the legal moves of the side to move, only captures and promotions if captures_only.
+// With return_on_found it stops at the first legal move and returns whether there was one.
+bool generate_moves_base(Board *board, DAi32 *moves, bool return_on_found, bool captures_only) {
 #if 1
-    bool (*gen_funcs[6])(Board *, size_t, DAi32 *, bool) = {
+    bool (*gen_funcs[6])(Board *, size_t, DAi32 *, bool, bool) = {
         [PAWN] = generate_pawn_moves,
         [BISHOP] = generate_bishop_moves,
         [KNIGHT] = generate_knight_moves,
@@ -643,7 +689,9 @@ void generate_moves(Board *board, DAi32 *moves) {
         while (piece_bb) {
             uint8_t piece_idx_offset = next_piece_idx(piece_bb);
             piece_idx += piece_idx_offset;
-            gen_funcs[piece_type](board, piece_idx, moves, false);
+            if (gen_funcs[piece_type](board, piece_idx, moves, return_on_found, captures_only)) {
+                return true;
+            }
             piece_bb >>= piece_idx_offset + 1;
             piece_bb &= -(64ULL > (piece_idx_offset + 1));
             ++piece_idx;
@@ -655,7 +703,7 @@ void generate_moves(Board *board, DAi32 *moves) {
     while (pawn_bb) {
         uint8_t pawn_idx_offset = next_piece_idx(pawn_bb);
         pawn_idx += pawn_idx_offset;
-        generate_pawn_moves(board, pawn_idx, moves, false);
+        generate_pawn_moves(board, pawn_idx, moves, false, false);
         pawn_bb >>= pawn_idx_offset + 1;
         pawn_bb &= -(63ULL > pawn_idx_offset);
         ++pawn_idx;
@@ -665,7 +713,7 @@ void generate_moves(Board *board, DAi32 *moves) {
     while (bishop_bb) {
         uint8_t bishop_idx_offset = next_piece_idx(bishop_bb);
         bishop_idx += bishop_idx_offset;
-        generate_bishop_moves(board, bishop_idx, moves, false);
+        generate_bishop_moves(board, bishop_idx, moves, false, false);
         bishop_bb >>= bishop_idx_offset + 1;
         bishop_bb &= -(63ULL > bishop_idx_offset);
         ++bishop_idx;
@@ -675,7 +723,7 @@ void generate_moves(Board *board, DAi32 *moves) {
     while (knight_bb) {
         uint8_t knight_idx_offset = next_piece_idx(knight_bb);
         knight_idx += knight_idx_offset;
-        generate_knight_moves(board, knight_idx, moves, false);
+        generate_knight_moves(board, knight_idx, moves, false, false);
         knight_bb >>= knight_idx_offset + 1;
         knight_bb &= -(63ULL > knight_idx_offset);
         ++knight_idx;
@@ -685,7 +733,7 @@ void generate_moves(Board *board, DAi32 *moves) {
     while (rook_bb) {
         uint8_t rook_idx_offset = next_piece_idx(rook_bb);
         rook_idx += rook_idx_offset;
-        generate_rook_moves(board, rook_idx, moves, false);
+        generate_rook_moves(board, rook_idx, moves, false, false);
         rook_bb >>= rook_idx_offset + 1ULL;
         rook_bb &= -(63ULL > rook_idx_offset);
         ++rook_idx;
@@ -695,7 +743,7 @@ void generate_moves(Board *board, DAi32 *moves) {
     while (queen_bb) {
         uint8_t queen_idx_offset = next_piece_idx(queen_bb);
         queen_idx += queen_idx_offset;
-        generate_queen_moves(board, queen_idx, moves, false);
+        generate_queen_moves(board, queen_idx, moves, false, false);
         queen_bb >>= queen_idx_offset + 1;
         queen_bb &= -(63ULL > queen_idx_offset);
         ++queen_idx;
@@ -704,12 +752,28 @@ void generate_moves(Board *board, DAi32 *moves) {
 
     uint64_t king_bb = board->king_bb[board->to_move];
     uint8_t king_idx = next_piece_idx(king_bb);
-    generate_king_moves(board, king_idx, moves, false);
+    return generate_king_moves(board, king_idx, moves, return_on_found, captures_only);
+}
 
+void generate_moves(Board *board, DAi32 *moves) {
+    time_t start_time = time_now();
+    generate_moves_base(board, moves, false, false);
     time_t end_time = time_now();
     board->time_to_generate_last_move_us = end_time - start_time;
 }
 
+void generate_captures(Board *board, DAi32 *moves) {
+    generate_moves_base(board, moves, false, true);
+}
+
+// Checkmate and stalemate tests only need one legal move, which is usually found
+// after validating a single candidate.
+bool has_legal_move(Board *board) {
+    uint32_t found[1];
+    DAi32 moves = {.data = found, .size = 0, .capacity = 1};
+    return generate_moves_base(board, &moves, true, false);
+}
+
 // ==================================
 
 void test_generate_initial_moves(void) {
@@ -762,6 +826,45 @@ void test_generate_initial_moves(void) {
     assert(strcmp(repr, expected) == 0);
 }
 
+void test_generate_captures(void) {
+    // Captures on d5 and e5 and a promotion on b8 among plenty of quiet moves.
+    Board *board = board_create();
+    (void) fen_to_board("4k3/1P6/8/3p1p2/4P3/8/8/4K3 w - - 0 1", board);
+    DAi32 all_moves = {0};
+    DAi32 captures = {0};
+    generate_moves(board, &all_moves);
+    generate_captures(board, &captures);
+
+    size_t n_noisy = 0;
+    for (size_t i = 0; i < all_moves.size; ++i) {
+        Move move = move_data_create(all_moves.data[i]);
+        n_noisy += move_is_type_of(move, CAPTURE | PROMOTION);
+    }
+    assert(captures.size == n_noisy);
+    assert(captures.size == 6);
+    for (size_t i = 0; i < captures.size; ++i) {
+        assert(move_is_type_of(move_data_create(captures.data[i]), CAPTURE | PROMOTION));
+    }
+    dai32_free(&all_moves);
+    dai32_free(&captures);
+}
+
+void test_has_legal_move(void) {
+    const char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "R5k1/5ppp/8/8/8/8/5PPP/6K1 b - - 0 1",  // Checkmate
+        "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1",  // Stalemate
+    };
+    const bool expected[] = {true, false, false};
+    for (size_t i = 0; i < 3; ++i) {
+        Board *board = board_create();
+        (void) fen_to_board(fens[i], board);
+        assert(has_legal_move(board) == expected[i]);
+    }
+}
+
 void test_generate(void) {
     test_wrapper(test_generate_initial_moves);
+    test_wrapper(test_generate_captures);
+    test_wrapper(test_has_legal_move);
 }
@@ -6,7 +6,12 @@
 #include "generate.h"
 #include "pgn.h"
 #include "engine.h"
+#include "eval.h"
 #include "result.h"
+#include "zobrist.h"
+#include "attacks.h"
+#include "tt.h"
+#include "timeman.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -23,6 +28,11 @@ void test(void) {
     test_wrapper(test_board);
     test_wrapper(test_move);
     test_wrapper(test_generate);
+    test_wrapper(test_attacks);
+    test_wrapper(test_zobrist);
+    test_wrapper(test_tt);
+    test_wrapper(test_time_manager);
+    test_wrapper(test_eval);
     test_wrapper(test_pgn);
     test_wrapper(test_engine);
     test_wrapper(test_result);
@@ -0,0 +1,148 @@
+#include <assert.h>
+
+#include "timeman.h"
+#include "defs.h"
+#include "utils.h"
+#include "tests.h"
+
+void time_manager_init(TimeManager *tm, time_t start, int64_t time_ms, int64_t inc_ms, size_t moves_to_go) {
+    int64_t available = time_ms - TM_MOVE_OVERHEAD_MS;
+    available = max(available, (int64_t) 1);
+    size_t n_moves = moves_to_go > 0 ? moves_to_go : TM_DEFAULT_MOVES_TO_GO;
+    n_moves = min(n_moves, (size_t) TM_MAX_MOVES_TO_GO);
+
+    int64_t hard_cap = available * TM_MAX_TIME_PCT / 100;
+    hard_cap = max(hard_cap, (int64_t) 1);
+    int64_t soft = available / (int64_t) n_moves + inc_ms * 3 / 4;
+    soft = min(soft, hard_cap);
+    int64_t hard = soft * TM_HARD_FACTOR;
+    hard = min(hard, hard_cap);
+
+    tm->enabled = true;
+    tm->fixed = false;
+    tm->start = start;
+    tm->soft_ms = max(soft, (int64_t) 1);
+    tm->hard_ms = max(hard, (int64_t) 1);
+    tm->scale_pct = 100;
+    tm->stable_iterations = 0;
+}
+
+// go movetime: the whole time is spent, so both limits are the same.
+void time_manager_init_move_time(TimeManager *tm, time_t start, int64_t move_time_ms) {
+    int64_t limit = move_time_ms - TM_MOVE_OVERHEAD_MS;
+    limit = max(limit, (int64_t) 1);
+    tm->enabled = true;
+    tm->fixed = true;
+    tm->start = start;
+    tm->soft_ms = limit;
+    tm->hard_ms = limit;
+    tm->scale_pct = 100;
+    tm->stable_iterations = 0;
+}
+
+void time_manager_disable(TimeManager *tm) {
+    tm->enabled = false;
+    tm->fixed = false;
+}
+
+// Called after every completed iteration. A best move that keeps changing needs more
+// time to settle, one that has been stable for a while is unlikely to change.
+void time_manager_update(TimeManager *tm, bool best_move_changed) {
+    if (tm->fixed) {
+        return;
+    }
+    if (best_move_changed) {
+        tm->stable_iterations = 0;
+        tm->scale_pct = TM_UNSTABLE_PCT;
+        return;
+    }
+    ++tm->stable_iterations;
+    size_t shrink = TM_STABLE_STEP_PCT * tm->stable_iterations;
+    tm->scale_pct = shrink < 100 - TM_MIN_PCT ? 100 - shrink : TM_MIN_PCT;
+}
+
+int64_t time_manager_elapsed_ms(TimeManager *tm) {
+    return (int64_t) (time_now() - tm->start) / 1000;
+}
+
+int64_t time_manager_soft_limit_ms(TimeManager *tm) {
+    if (tm->fixed) {
+        return tm->hard_ms;
+    }
+    int64_t soft = tm->soft_ms * (int64_t) tm->scale_pct / 100;
+    return min(soft, tm->hard_ms);
+}
+
+bool time_manager_soft_exceeded(TimeManager *tm) {
+    return tm->enabled && time_manager_elapsed_ms(tm) >= time_manager_soft_limit_ms(tm);
+}
+
+bool time_manager_hard_exceeded(TimeManager *tm) {
+    return tm->enabled && time_manager_elapsed_ms(tm) >= tm->hard_ms;
+}
+
+// ====================================
+
+void test_time_manager_clock(void) {
+    TimeManager tm = {0};
+    time_manager_init(&tm, 0, 60000, 0, 0);
+    assert(tm.soft_ms == (60000 - TM_MOVE_OVERHEAD_MS) / TM_DEFAULT_MOVES_TO_GO);
+    assert(tm.hard_ms == tm.soft_ms * TM_HARD_FACTOR);
+
+    // The increment is mostly spent, and moves to go splits the remaining time.
+    time_manager_init(&tm, 0, 60000, 1000, 10);
+    assert(tm.soft_ms == (60000 - TM_MOVE_OVERHEAD_MS) / 10 + 750);
+
+    // With one move to go or almost no time left, the limits stay inside the clock.
+    time_manager_init(&tm, 0, 1000, 0, 1);
+    assert(tm.hard_ms < 1000 && tm.soft_ms <= tm.hard_ms);
+    time_manager_init(&tm, 0, 10, 0, 0);
+    assert(tm.soft_ms == 1 && tm.hard_ms == 1);
+
+    time_manager_init_move_time(&tm, 0, 500);
+    assert(tm.soft_ms == 500 - TM_MOVE_OVERHEAD_MS);
+    assert(time_manager_soft_limit_ms(&tm) == tm.hard_ms);
+}
+
+void test_time_manager_stability(void) {
+    TimeManager tm = {0};
+    time_manager_init(&tm, 0, 60000, 0, 0);
+    int64_t base = time_manager_soft_limit_ms(&tm);
+
+    time_manager_update(&tm, true);
+    assert(time_manager_soft_limit_ms(&tm) > base);
+    time_manager_update(&tm, false);
+    time_manager_update(&tm, false);
+    assert(time_manager_soft_limit_ms(&tm) < base);
+    for (size_t i = 0; i < 20; ++i) {
+        time_manager_update(&tm, false);
+    }
+    assert(time_manager_soft_limit_ms(&tm) == base * TM_MIN_PCT / 100);
+}
+
+void test_time_manager_move_time(void) {
+    TimeManager tm = {0};
+    time_manager_init_move_time(&tm, 0, 2000);
+    const int64_t limit = 2000 - TM_MOVE_OVERHEAD_MS;
+
+    // The best move changing or settling down does not move the limit, the whole time is used.
+    time_manager_update(&tm, true);
+    assert(time_manager_soft_limit_ms(&tm) == limit);
+    for (size_t i = 0; i < 20; ++i) {
+        time_manager_update(&tm, false);
+        assert(time_manager_soft_limit_ms(&tm) == limit);
+    }
+    assert(tm.hard_ms == limit);
+
+    // A clock search afterwards scales again.
+    time_manager_init(&tm, 0, 60000, 0, 0);
+    int64_t base = time_manager_soft_limit_ms(&tm);
+    time_manager_update(&tm, true);
+    assert(time_manager_soft_limit_ms(&tm) > base);
+}
+
+void test_time_manager(void) {
+    test_wrapper(test_time_manager_clock);
+    test_wrapper(test_time_manager_stability);
+    test_wrapper(test_time_manager_move_time);
+}
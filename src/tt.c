@@ -0,0 +1,194 @@
+#include <assert.h>
+#include <string.h>
+
+#include "tt.h"
+#include "common.h"
+#include "utils.h"
+#include "tests.h"
+
+TT *tt_create(size_t size_mb) {
+    TT *tt = (TT *) arena_allocate(&arena, sizeof(TT));
+    tt->entries = NULL;
+    tt->n_clusters = 0;
+    tt->age = 0;
+    tt_resize(tt, size_mb);
+    return tt;
+}
+
+// Returns false when there is not enough memory, the table then keeps its previous size or a smaller one.
+bool tt_resize(TT *tt, size_t size_mb) {
+    size_t cluster_size = TT_CLUSTER_SIZE * sizeof(TTEntry);
+    size_t n_clusters = 1;
+    while (2 * n_clusters * cluster_size <= size_mb * 1024 * 1024) {
+        n_clusters *= 2;
+    }
+    aligned_free(tt->entries);
+    tt->entries = (TTEntry *) aligned_malloc(CACHE_LINE_SIZE, n_clusters * cluster_size);
+    bool resized = tt->entries != NULL;
+    size_t fallback = tt->n_clusters > 0 && tt->n_clusters < n_clusters ? tt->n_clusters : n_clusters / 2;
+    while (tt->entries == NULL && fallback > 0) {
+        n_clusters = fallback;
+        tt->entries = (TTEntry *) aligned_malloc(CACHE_LINE_SIZE, n_clusters * cluster_size);
+        fallback /= 2;
+    }
+    tt->n_clusters = n_clusters;
+    tt_clear(tt);
+    return resized;
+}
+
+size_t tt_size_mb(TT *tt) {
+    return tt->n_clusters * TT_CLUSTER_SIZE * sizeof(TTEntry) / (1024 * 1024);
+}
+
+void tt_clear(TT *tt) {
+    memset(tt->entries, 0, tt->n_clusters * TT_CLUSTER_SIZE * sizeof(TTEntry));
+    tt->age = 0;
+}
+
+void tt_new_search(TT *tt) {
+    tt->age = (tt->age + 1) & 63;
+}
+
+uint16_t tt_pack_move(Move move) {
+    return (uint16_t) (move.from | (move.to << 6) | (move.promoted_type << 12));
+}
+
+bool tt_move_matches(uint16_t packed, Move move) {
+    return packed != 0 && packed == tt_pack_move(move);
+}
+
+TTEntry *tt_cluster(TT *tt, uint64_t key) {
+    return tt->entries + (key & (tt->n_clusters - 1)) * TT_CLUSTER_SIZE;
+}
+
+bool tt_probe(TT *tt, uint64_t key, TTData *data) {
+    TTEntry *cluster = tt_cluster(tt, key);
+    for (size_t i = 0; i < TT_CLUSTER_SIZE; ++i) {
+        // Read each word once; other threads may be writing the entry concurrently.
+        uint64_t entry_data = cluster[i].data;
+        uint64_t entry_key = cluster[i].key;
+        if ((entry_key ^ entry_data) == key) {
+            data->data = entry_data;
+            return data->bound != TT_NONE;
+        }
+    }
+    return false;
+}
+
+void tt_store(TT *tt, uint64_t key, Move move, int64_t score, size_t depth, TTBound bound) {
+    TTEntry *cluster = tt_cluster(tt, key);
+    TTEntry *replace = cluster;
+    int replace_value = INT32_MAX;
+    TTData old = {0};
+    for (size_t i = 0; i < TT_CLUSTER_SIZE; ++i) {
+        TTData entry = {.data = cluster[i].data};
+        if ((cluster[i].key ^ entry.data) == key) {
+            // Keep a deeper result for the same position unless the new one is exact.
+            if (bound != TT_EXACT && entry.age == tt->age && depth + 2 < entry.depth) {
+                return;
+            }
+            replace = cluster + i;
+            old = entry;
+            break;
+        }
+        // Prefer replacing shallow entries and entries left over from older searches.
+        int value = (int) entry.depth - 8 * ((tt->age - entry.age) & 63);
+        if (value < replace_value) {
+            replace_value = value;
+            replace = cluster + i;
+        }
+    }
+
+    TTData data = {0};
+    data.move = is_move_null(move) ? old.move : tt_pack_move(move);
+    data.score = score;
+    data.depth = depth;
+    data.bound = bound;
+    data.age = tt->age;
+    replace->key = key ^ data.data;
+    replace->data = data.data;
+}
+
+// Permill of entries used by the current search, estimated from the first clusters.
+size_t tt_hashfull(TT *tt) {
+    size_t n_entries = min(tt->n_clusters * TT_CLUSTER_SIZE, (size_t) TT_HASHFULL_SAMPLE);
+    size_t used = 0;
+    for (size_t i = 0; i < n_entries; ++i) {
+        TTData entry = {.data = tt->entries[i].data};
+        used += entry.bound != TT_NONE && entry.age == tt->age;
+    }
+    return used * 1000 / n_entries;
+}
+
+// ====================================
+
+void test_tt_data_size(void) {
+    TTData data = {0};
+    assert(sizeof(data) == sizeof(data.data));
+    assert(sizeof(TTEntry) * TT_CLUSTER_SIZE == CACHE_LINE_SIZE);
+}
+
+void test_tt_store_probe(void) {
+    TT *tt = tt_create(1);
+    Piece piece = piece_create(WHITE, PAWN);
+    Move move = move_create(piece, COORD_TO_IDX("e7"), COORD_TO_IDX("e8"), PROMOTION, QUEEN, NONE);
+    uint64_t key = 0x0123456789ABCDEFULL;
+
+    TTData data = {0};
+    assert(!tt_probe(tt, key, &data));
+
+    tt_store(tt, key, move, -1234, 7, TT_LOWER);
+    assert(tt_probe(tt, key, &data));
+    assert(tt_move_matches((uint16_t) data.move, move));
+    assert(data.score == -1234);
+    assert(data.depth == 7);
+    assert(data.bound == TT_LOWER);
+    assert(!tt_probe(tt, key ^ 1, &data));
+
+    // A torn entry, half written by another thread, must not verify.
+    TTEntry *entry = tt->entries + (key & (tt->n_clusters - 1)) * TT_CLUSTER_SIZE;
+    entry->data ^= 1ULL << 20;
+    assert(!tt_probe(tt, key, &data));
+
+    aligned_free(tt->entries);
+}
+
+void test_tt_hashfull(void) {
+    TT *tt = tt_create(1);
+    assert(tt_hashfull(tt) == 0);
+
+    Move move = {0};
+    for (uint64_t cluster = 0; cluster < TT_HASHFULL_SAMPLE / TT_CLUSTER_SIZE / 2; ++cluster) {
+        tt_store(tt, cluster, move, 0, 1, TT_EXACT);
+    }
+    assert(tt_hashfull(tt) == 1000 / TT_CLUSTER_SIZE / 2);
+
+    // Entries of a previous search count as free.
+    tt_new_search(tt);
+    assert(tt_hashfull(tt) == 0);
+
+    aligned_free(tt->entries);
+}
+
+void test_tt_resize(void) {
+    TT *tt = tt_create(2);
+    assert(tt_size_mb(tt) == 2);
+    assert(tt_resize(tt, 3));
+    assert(tt_size_mb(tt) == 2);
+
+    // An allocation that cannot succeed falls back to the previous size.
+    assert(!tt_resize(tt, (size_t) 1 << 40));
+    assert(tt_size_mb(tt) == 2);
+    Move move = {0};
+    tt_store(tt, 42, move, 7, 1, TT_EXACT);
+    TTData data;
+    assert(tt_probe(tt, 42, &data) && data.score == 7);
+    aligned_free(tt->entries);
+}
+
+void test_tt(void) {
+    test_wrapper(test_tt_data_size);
+    test_wrapper(test_tt_store_probe);
+    test_wrapper(test_tt_hashfull);
+    test_wrapper(test_tt_resize);
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <time.h>
@@ -21,10 +22,13 @@ UCI *uci_create(void) {
     UCI *uci = (UCI *) arena_allocate(&arena, sizeof(UCI));
     uci->state = UCI_NOT_READY;
     uci->engine = engine_create(send_info_score_cp);
+    uci->engine->on_currmove = send_info_currmove;
     uci->board = board_create();
     uci->last_move = move_data_create(0);
     uci->log_fp = fopen("logs.txt", "a");
     uci->pid = getpid();
+    uci->searching = false;
+    mutex_init(&uci->io_mutex);
     return uci;
 }
 
@@ -59,10 +63,12 @@ void _uci_log_base(const char *prefix, const char*fmt, va_list args) {
     char buffer[26];
     curr_time(buffer);
 
+    mutex_lock(&uci->io_mutex);
     fprintf(uci->log_fp, "%.2s %d %s ", prefix, getpid(), buffer);
     vfprintf(uci->log_fp, fmt, args);
     fprintf(uci->log_fp, "\n");
     fflush(uci->log_fp);
+    mutex_unlock(&uci->io_mutex);
 }
 
 void uci_log(const char *prefix, const char *fmt, ...) {
@@ -76,17 +82,16 @@ void uci_log(const char *prefix, const char *fmt, ...) {
 void send_message(const char *fmt, ...) {
     va_list args_1;
 
+    mutex_lock(&uci->io_mutex);
     va_start(args_1, fmt);
     vprintf(fmt, args_1);
     printf("\n");
     fflush(stdout);
     va_end(args_1);
+    mutex_unlock(&uci->io_mutex);
 
     va_list args_2;
 
-    char buffer[26];
-    curr_time(buffer);
-
     va_start(args_2, fmt);
     _uci_log_base("< ", fmt, args_2);
     va_end(args_2);
@@ -99,21 +104,59 @@ void log_input(const char* input) {
 void send_uci_ok() {
     send_message("id name %s", ENGINE_NAME);
     send_message("id author %s", ENGINE_AUTHOR);
+    send_message("option name Hash type spin default %d min 1 max %d", TT_DEFAULT_SIZE_MB, TT_MAX_SIZE_MB);
+    send_message("option name EvalCache type spin default %d min 1 max %d", EVAL_CACHE_DEFAULT_SIZE_MB, EVAL_CACHE_MAX_SIZE_MB);
+    send_message("option name Threads type spin default 1 min 1 max %d", MAX_THREADS);
+    send_message("option name Ponder type check default false");
+    send_message("option name MultiPV type spin default 1 min 1 max %d", MAX_MULTI_PV);
+    send_message("option name Deterministic type check default false");
     send_message("uciok");
 }
 
 void send_is_ready() {
     engine_start(uci->engine);
-    if (uci->engine->state == ENGINE_READY) {
+    // A running search must not delay the reply.
+    if (uci->engine->state == ENGINE_READY || uci->engine->state == ENGINE_BUSY) {
         uci->state = UCI_READY;
         send_message("readyok");
     }
 }
 
-void send_info_score_cp(Move move, size_t depth, int64_t cp) {
+void send_info_score_cp(const SearchInfo *info) {
+    char pv_str[MAX_PLY * 6] = { 0 };
+    size_t length = 0;
+    for (size_t i = 0; i < info->pv_length; ++i) {
+        if (i > 0) {
+            pv_str[length++] = ' ';
+        }
+        move_to_uci(move_data_create(info->pv[i]), pv_str + length);
+        length += strlen(pv_str + length);
+    }
+    char score_str[32] = { 0 };
+    if (info->mate != 0) {
+        snprintf(score_str, sizeof(score_str), "mate %d", (int) info->mate);
+    } else {
+        snprintf(score_str, sizeof(score_str), "cp %d", (int) info->score);
+    }
+    send_message("info depth %zu seldepth %zu multipv %zu score %s nodes %zu nps %zu time %zu hashfull %zu pv %s",
+            info->depth, info->seldepth, info->multi_pv, score_str,
+            info->nodes, info->nps, info->time_ms, info->hashfull, pv_str);
+}
+
+void send_info_currmove(Move move, size_t number, size_t depth) {
     char uci_move_str[6] = { 0 };
     move_to_uci(move, uci_move_str);
-    send_message("info depth %zu score cp %d pv %s", depth, (int) cp, uci_move_str);
+    send_message("info depth %zu currmove %s currmovenumber %zu", depth, uci_move_str, number);
+}
+
+void send_info_stats(void) {
+    SearchStats *stats = &uci->engine->stats;
+    size_t first_move_permill = stats->beta_cutoffs > 0
+        ? stats->first_move_cutoffs * 1000 / stats->beta_cutoffs
+        : 0;
+    send_message("info string nodes %zu qnodes %zu tthits %zu cutoffs %zu firstmovecutoffs %zu.%zu%% seldepth %zu",
+            stats->nodes, stats->qnodes, stats->tt_hits, stats->beta_cutoffs,
+            first_move_permill / 10, first_move_permill % 10, stats->seldepth);
 }
 
 const char *uci_store_board(const char *fen) {
@@ -171,17 +214,156 @@ void parse_position_command(const char *input) {
     da_free(da);
 }
 
-void send_best_move() {
-    Move move = engine_best_move(uci->engine, uci->board);
+size_t parse_option_value(void) {
+    skip_whitespace();
+    expect_str("value");
+    skip_whitespace();
+    const char *start = stream;
+    scan_numeric();
+    return (size_t) strtoull(start, NULL, 10);
+}
+
+bool parse_option_bool(void) {
+    skip_whitespace();
+    expect_str("value");
+    skip_whitespace();
+    return soft_expect_str("true");
+}
+
+void parse_setoption_command(const char *input) {
+    start_parsing(input);
+
+    expect_str("setoption");
+    skip_whitespace();
+    expect_str("name");
+    skip_whitespace();
+
+    if (soft_expect_str("Threads")) {
+        engine_set_threads(uci->engine, parse_option_value());
+    } else if (soft_expect_str("Hash")) {
+        if (!engine_set_hash_size(uci->engine, parse_option_value())) {
+            send_message("info string not enough memory, Hash is %zu MB", tt_size_mb(uci->engine->tt));
+        }
+    } else if (soft_expect_str("EvalCache")) {
+        if (!engine_set_eval_cache_size(uci->engine, parse_option_value())) {
+            send_message("info string not enough memory, EvalCache is %zu MB", eval_cache_size_mb(uci->engine->eval_cache));
+        }
+    } else if (soft_expect_str("MultiPV")) {
+        engine_set_multi_pv(uci->engine, parse_option_value());
+    } else if (soft_expect_str("Deterministic")) {
+        // Equal moves are no longer picked at random, so a single threaded search with a
+        // depth or node limit always gives the same move and node count.
+        uci->engine->random_tie_break = !parse_option_bool();
+    } else if (soft_expect_str("Ponder")) {
+        // Only tells us that the GUI may send go ponder, nothing to configure.
+    } else {
+        uci_log("##", "Unknown option %s", stream);
+    }
+}
+
+size_t parse_go_value(void) {
+    skip_whitespace();
+    const char *start = stream;
+    scan_numeric();
+    return (size_t) strtoull(start, NULL, 10);
+}
+
+// Clock values can be negative when the GUI lets the engine run over its time.
+int64_t parse_go_time(void) {
+    skip_whitespace();
+    bool negative = soft_expect('-');
+    int64_t value = (int64_t) parse_go_value();
+    return negative ? -value : value;
+}
+
+SearchLimits parse_go_command(const char *input) {
+    SearchLimits limits = {0};
+    start_parsing(input);
+
+    expect_str("go");
+    skip_whitespace();
+    while (*stream) {
+        if (soft_expect_str("infinite")) {
+            limits.infinite = true;
+        } else if (soft_expect_str("ponder")) {
+            limits.ponder = true;
+        } else if (soft_expect_str("depth")) {
+            limits.depth = parse_go_value();
+        } else if (soft_expect_str("nodes")) {
+            limits.nodes = parse_go_value();
+        } else if (soft_expect_str("wtime")) {
+            limits.clock = true;
+            limits.time[WHITE] = parse_go_time();
+        } else if (soft_expect_str("btime")) {
+            limits.clock = true;
+            limits.time[BLACK] = parse_go_time();
+        } else if (soft_expect_str("winc")) {
+            limits.inc[WHITE] = parse_go_time();
+        } else if (soft_expect_str("binc")) {
+            limits.inc[BLACK] = parse_go_time();
+        } else if (soft_expect_str("movestogo")) {
+            limits.moves_to_go = parse_go_value();
+        } else if (soft_expect_str("movetime")) {
+            limits.move_time = parse_go_time();
+        } else {
+            // Unsupported parameters and their values are ignored.
+            while (*stream && !is_whitespace(*stream)) {
+                next_char();
+            }
+        }
+        skip_whitespace();
+    }
+    return limits;
+}
+
+void send_best_move(SearchLimits limits) {
+    Move move = engine_best_move(uci->engine, uci->board, limits);
+    send_info_stats();
     char uci_move_str[6] = { 0 };
     uci->last_move = move;
     move_to_uci(move, uci_move_str);
     apply_move(uci->board, move);
-    send_message("bestmove %s", uci_move_str);
+    if (is_move_null(uci->engine->ponder_move)) {
+        send_message("bestmove %s", uci_move_str);
+    } else {
+        char uci_ponder_str[6] = { 0 };
+        move_to_uci(uci->engine->ponder_move, uci_ponder_str);
+        send_message("bestmove %s ponder %s", uci_move_str, uci_ponder_str);
+    }
 
     uci_log("**", "elapsed = %zu us", uci->board->time_to_generate_last_move_us);
 }
 
+void search_thread_uci_main(void *arg) {
+    send_best_move(*(SearchLimits *) arg);
+}
+
+static SearchLimits search_limits;  // Of the running search, read by its thread
+
+// Runs the search on its own thread so that the input loop can still answer
+// isready and stop while it is running.
+void start_search(SearchLimits limits) {
+    wait_search();
+    search_limits = limits;
+    atomic_store(&uci->engine->stop, false);
+    atomic_store(&uci->engine->pondering, limits.ponder);
+    uci->searching = thread_create(&uci->search_thread, search_thread_uci_main, &search_limits);
+    if (!uci->searching) {
+        send_best_move(limits);
+    }
+}
+
+// A go infinite or go ponder search only ends on stop, so it is stopped rather than waited for.
+void wait_search(void) {
+    if (uci->searching) {
+        if (search_limits.infinite || atomic_load(&uci->engine->pondering)) {
+            engine_stop(uci->engine);
+        }
+        thread_join(uci->search_thread);
+        uci->searching = false;
+    }
+}
+
 void start_uci(void) {
     uci = uci_create();
 
@@ -192,28 +374,36 @@ void start_uci(void) {
         }
         log_input(input);
 
-        if (match_cmd(input, "uci")) {
+        if (match_cmd(input, "ucinewgame")) {
+            wait_search();
+            engine_new_game(uci->engine);
+        } else if (match_cmd(input, "uci")) {
             send_uci_ok();
         } else if (match_cmd(input, "isready")) {
             send_is_ready();
-        } else if (match_cmd(input, "ucinewgame")) {
-            continue;
+        } else if (match_cmd(input, "setoption")) {
+            wait_search();
+            parse_setoption_command(input);
         } else if (match_cmd(input, "position")) {
+            wait_search();
             parse_position_command(input);
         } else if (match_cmd(input, "go")) {
-            send_best_move();
+            start_search(parse_go_command(input));
+        } else if (match_cmd(input, "ponderhit")) {
+            engine_ponderhit(uci->engine);
         } else if (match_cmd(input, "stop")) {
-            char uci_move_str[6] = {0};
-            move_to_uci(uci->last_move, uci_move_str);
-            send_message("bestmove %s", uci_move_str);
-            // When mult-threading, send the current best move.
-            continue;
+            // The search thread sends the best move of its last completed iteration.
+            engine_stop(uci->engine);
+            wait_search();
         } else if (match_cmd(input, "quit")) {
+            free(input);
             break;
         }
         fflush(stdout);
         free(input);
     }
+    engine_stop(uci->engine);
+    wait_search();
     send_message("Exiting.");
     fclose(uci->log_fp);
 }
@@ -9,9 +9,11 @@
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <intrin.h>
 #include <stdint.h>
 #else
 #include <sys/time.h>
+#include <time.h>
 #endif
 
 unsigned rand_lim(unsigned limit) {
@@ -50,6 +52,17 @@ time_t time_now(void) {
 #endif
 }
 
+void sleep_ms(unsigned ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
 char *read_file(const char *path) {
     FILE *fp = fopen(path, "rb");
     if (!fp) {
@@ -84,6 +97,103 @@ uint8_t next_piece_idx(uint64_t bb) {
 #endif
 }
 
+size_t count_bits(uint64_t bb) {
+#if _WIN32
+    return _mm_popcnt_u64(bb);
+#else
+    return __builtin_popcountll(bb);
+#endif
+}
+
+typedef struct ThreadStart {
+    thread_main_f main;
+    void *arg;
+} ThreadStart;
+
+#ifdef _WIN32
+DWORD WINAPI _thread_start(LPVOID param) {
+#else
+void *_thread_start(void *param) {
+#endif
+    ThreadStart start = *(ThreadStart *) param;
+    free(param);
+    start.main(start.arg);
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+bool thread_create(Thread *thread, thread_main_f main, void *arg) {
+    ThreadStart *start = (ThreadStart *) malloc(sizeof(ThreadStart));
+    start->main = main;
+    start->arg = arg;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, _thread_start, start, 0, NULL);
+    bool created = *thread != NULL;
+#else
+    bool created = pthread_create(thread, NULL, _thread_start, start) == 0;
+#endif
+    if (!created) {
+        free(start);
+    }
+    return created;
+}
+
+void thread_join(Thread thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+void mutex_init(Mutex *mutex) {
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void mutex_lock(Mutex *mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void *aligned_malloc(size_t alignment, size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+void aligned_free(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 char *read_line(FILE *fp) {
     char *buffer = NULL;
     size_t buffer_size = 0;
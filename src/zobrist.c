@@ -0,0 +1,111 @@
+#include <assert.h>
+#include <stdbool.h>
+
+#include "zobrist.h"
+#include "board.h"
+#include "defs.h"
+#include "tests.h"
+
+uint64_t zobrist_pieces[2][7][64];
+uint64_t zobrist_black_to_move;
+uint64_t zobrist_castling[16];
+uint64_t zobrist_en_passant[8];
+
+// splitmix64 with a fixed seed, so keys are identical across runs and builds.
+uint64_t zobrist_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void zobrist_init(void) {
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    uint64_t state = 0x6D756E6368657373ULL;
+    for (size_t color = 0; color < 2; ++color) {
+        for (size_t type = PAWN; type <= KING; ++type) {
+            for (size_t idx = 0; idx < 64; ++idx) {
+                zobrist_pieces[color][type][idx] = zobrist_next(&state);
+            }
+        }
+    }
+    zobrist_black_to_move = zobrist_next(&state);
+    zobrist_castling[0] = 0;
+    for (size_t i = 1; i < 16; ++i) {
+        zobrist_castling[i] = zobrist_next(&state);
+    }
+    for (size_t i = 0; i < 8; ++i) {
+        zobrist_en_passant[i] = zobrist_next(&state);
+    }
+    initialized = true;
+}
+
+// ====================================
+
+void test_zobrist_transposition(void) {
+    Board *board_1 = board_create();
+    Board *board_2 = board_create();
+    place_initial_pieces(board_1);
+    place_initial_pieces(board_2);
+
+    const char *moves_1[] = {"g1f3", "g8f6", "b1c3"};
+    const char *moves_2[] = {"b1c3", "g8f6", "g1f3"};
+    for (size_t i = 0; i < sizeof(moves_1) / sizeof(moves_1[0]); ++i) {
+        apply_move(board_1, uci_notation_to_move(moves_1[i], board_1));
+        apply_move(board_2, uci_notation_to_move(moves_2[i], board_2));
+    }
+    assert(board_key(board_1) == board_key(board_2));
+
+    Board *board_3 = board_create();
+    (void) fen_to_board("rnbqkb1r/pppppppp/5n2/8/8/2N2N2/PPPPPPPP/R1BQKB1R b KQkq - 3 2", board_3);
+    assert(board_key(board_1) == board_key(board_3));
+}
+
+void test_zobrist_undo(void) {
+    Board *board = board_create();
+    place_initial_pieces(board);
+    uint64_t initial_key = board_key(board);
+
+    const char *moves[] = {"e2e4", "d7d5", "e4d5", "d8d5", "g1f3"};
+    for (size_t i = 0; i < sizeof(moves) / sizeof(moves[0]); ++i) {
+        apply_move(board, uci_notation_to_move(moves[i], board));
+        assert(board_key(board) != initial_key);
+    }
+    for (size_t i = 0; i < sizeof(moves) / sizeof(moves[0]); ++i) {
+        undo_last_move(board);
+    }
+    assert(board_key(board) == initial_key);
+
+    apply_null_move(board);
+    assert(board_key(board) == (initial_key ^ zobrist_black_to_move));
+    undo_null_move(board);
+    assert(board_key(board) == initial_key);
+}
+
+void test_zobrist_pawn_hash(void) {
+    Board *board = board_create();
+    place_initial_pieces(board);
+    uint64_t initial_pawn_hash = board->pawn_hash;
+
+    apply_move(board, uci_notation_to_move("g1f3", board));
+    assert(board->pawn_hash == initial_pawn_hash);
+    apply_move(board, uci_notation_to_move("e7e5", board));
+    assert(board->pawn_hash != initial_pawn_hash);
+
+    Board *board_2 = board_create();
+    (void) fen_to_board("rnbqkbnr/pppp1ppp/8/4p3/8/5N2/PPPPPPPP/RNBQKB1R w KQkq e6 0 2", board_2);
+    assert(board->pawn_hash == board_2->pawn_hash);
+
+    undo_last_move(board);
+    undo_last_move(board);
+    assert(board->pawn_hash == initial_pawn_hash);
+}
+
+void test_zobrist(void) {
+    test_wrapper(test_zobrist_transposition);
+    test_wrapper(test_zobrist_undo);
+    test_wrapper(test_zobrist_pawn_hash);
+}